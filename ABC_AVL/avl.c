@@ -27,6 +27,9 @@ struct  avl_node_t {
 	void *data;
 
 	unsigned char height;
+
+	/* number of nodes in the subtree rooted here */
+	int size;
 };
 
 typedef struct avl_tree_t avl_tree_t;
@@ -47,6 +50,10 @@ unsigned char max(unsigned char a, unsigned char b) {
 	return a < b ? b : a;
 }
 
+static int __avl_size(avl_node_t *avl_node) {
+	return avl_node ? avl_node->size : 0;
+}
+
 /**
  * Helper function to create a node
  * @data: the data to be added in the node
@@ -67,6 +74,7 @@ static avl_node_t *__avl_node_create(void *data, size_t data_size)
 	memcpy(avl_node->data, data, data_size);
 
 	avl_node->height = 0;
+	avl_node->size = 1;
 
 	return avl_node;
 }
@@ -92,48 +100,60 @@ avl_tree_t *avl_tree_create(size_t data_size,
 	return avl_tree;
 }
 
+static int __avl_height(avl_node_t *avl_node) {
+	return avl_node ? avl_node->height : -1;
+}
+
+/*
+* Helper function to recompute the height and the size of a node from its children
+*/
+
+static void __avl_update(avl_node_t *avl_node) {
+	int a = __avl_height(avl_node->left), b = __avl_height(avl_node->right);
+	// not max(), which would turn the -1 of a missing child into 255
+	avl_node->height = (a < b ? b : a) + 1;
+	avl_node->size = __avl_size(avl_node->left) + __avl_size(avl_node->right) + 1;
+}
+
+/*
+* Helper functions to rotate the subtree rooted at x, returning its new root
+*/
+
+static avl_node_t *__avl_rotate_right(avl_node_t *x) {
+	avl_node_t *y = x->left;
+
+	x->left = y->right;
+	y->right = x;
+	__avl_update(x);
+	__avl_update(y);
+	return y;
+}
+
+static avl_node_t *__avl_rotate_left(avl_node_t *x) {
+	avl_node_t *y = x->right;
+
+	x->right = y->left;
+	y->left = x;
+	__avl_update(x);
+	__avl_update(y);
+	return y;
+}
+
 /*
 * Helper function to rotate right (when we have to consecutive lefts with no right child)
 */
 
 void turn_right(void *ptr, char side) {
-	avl_node_t *x, *y, *temp;
 	if (side == 2) {
 		avl_tree_t *avl_tree = (avl_tree_t*)ptr;
-		x = avl_tree->root;
-		y = x->left;
-
-		temp = y->right;
-		y->right = x;
-		avl_tree->root = y;
-		x->left = temp;
+		avl_tree->root = __avl_rotate_right(avl_tree->root);
 	} else if (side == 1) {
 		avl_node_t *parent = (avl_node_t*)ptr;
-		x = parent->right;
-		y = x->left;
-
-		temp = y->right;
-		y->right = x;
-		parent->right = y;
-		x->left = temp;
+		parent->right = __avl_rotate_right(parent->right);
 	} else {
 		avl_node_t *parent = (avl_node_t*)ptr;
-		x = parent->left;
-		y = x->left;
-
-		temp = y->right;
-		y->right = x;
-		parent->left = y;
-		x->left = temp;
+		parent->left = __avl_rotate_right(parent->left);
 	}
-	int a = -1, b = -1;
-	if (x->left) a = x->left->height;
-	if (x->right) b = x->right->height;
-	x->height = max(a, b) + 1;
-	a = -1; b = -1;
-	if (y->left) a = y->left->height;
-	if (y->right) b = y->right->height;
-	y->height = max(a, b) + 1;
 }
 
 /*
@@ -141,404 +161,127 @@ void turn_right(void *ptr, char side) {
 */
 
 void turn_left(void *ptr, char side) {
-	avl_node_t *x, *y, *temp;
 	if (side == 2) {
 		avl_tree_t *avl_tree = (avl_tree_t*)ptr;
-		x = avl_tree->root;
-		y = x->right;
-
-		temp = y->left;
-		y->left = x;
-		avl_tree->root = y;
-		x->right = temp;
+		avl_tree->root = __avl_rotate_left(avl_tree->root);
 	} else if (side == 1) {
 		avl_node_t *parent = (avl_node_t*)ptr;
-		x = parent->right;
-		y = x->right;
-
-		temp = y->left;
-		y->left = x;
-		parent->right = y;
-		x->right = temp;
+		parent->right = __avl_rotate_left(parent->right);
 	} else {
 		avl_node_t *parent = (avl_node_t*)ptr;
-		x = parent->left;
-		y = x->right;
+		parent->left = __avl_rotate_left(parent->left);
+	}
+}
 
-		temp = y->left;
-		y->left = x;
-		parent->left = y;
-		x->right = temp;
+/*
+* Helper function to restore the balance of a node whose subtrees differ in height
+* by at most 2, returning the new root of its subtree
+*/
+
+static avl_node_t *__avl_rebalance(avl_node_t *avl_node) {
+	__avl_update(avl_node);
+	int balance = __avl_height(avl_node->right) - __avl_height(avl_node->left);
+	if (balance == -2) {
+		avl_node_t *curr = avl_node->left;
+		if (__avl_height(curr->right) > __avl_height(curr->left))
+			avl_node->left = __avl_rotate_left(curr);
+		return __avl_rotate_right(avl_node);
+	} else if (balance == 2) {
+		avl_node_t *curr = avl_node->right;
+		if (__avl_height(curr->left) > __avl_height(curr->right))
+			avl_node->right = __avl_rotate_right(curr);
+		return __avl_rotate_left(avl_node);
 	}
-	int a = -1, b = -1;
-	if (x->left) a = x->left->height;
-	if (x->right) b = x->right->height;
-	x->height = max(a, b) + 1;
-	a = -1; b = -1;
-	if (y->left) a = y->left->height;
-	if (y->right) b = y->right->height;
-	y->height = max(a, b) + 1;
+	return avl_node;
 }
 
 /**
- * Insert a new element in a avl
- * @avl_tree: the avl where to insert the new element
+ * Helper function to insert a new element in a avl
+ * @avl_node: the subtree's root where to insert the new element (may be NULL)
  * @data: the data to be inserted in avl
+ * @succes: set to 1 if the element was already in the avl
+ * @return: the new root of the subtree, rebalanced
  */
 
-void __avl_tree_insert(avl_node_t *avl_node, void *data, int data_size, int (*cmp)(const void *key1, const void *key2), int *succes) {
+avl_node_t *__avl_tree_insert(avl_node_t *avl_node, void *data, int data_size, int (*cmp)(const void *key1, const void *key2), int *succes) {
+	if (!avl_node)
+		return __avl_node_create(data, data_size);
 	int rc = cmp(data, avl_node->data);
 	if (rc < 0) {
-		if (avl_node->left) {
-			__avl_tree_insert(avl_node->left, data, data_size, cmp, succes);
-		} else {
-			avl_node_t *node = __avl_node_create(data, data_size);
-			avl_node->left = node;
-			if (avl_node->right) {
-				avl_node->height = avl_node->right->height + 1;
-			} else {
-				avl_node->height = 1;
-			}
-			return;
-		}
+		avl_node->left = __avl_tree_insert(avl_node->left, data, data_size, cmp, succes);
 	} else if (rc > 0) {
-		if (avl_node->right) {
-			__avl_tree_insert(avl_node->right, data, data_size, cmp, succes);
-		} else {
-			avl_node_t *node = __avl_node_create(data, data_size);
-			avl_node->right = node;
-			if (avl_node->left) {
-				avl_node->height = avl_node->left->height + 1;
-			} else {
-				avl_node->height = 1;
-			}
-			return;
-		}
-	} else if (rc == 0){
-		*succes = 1;
-		return;
-	}
-	int a = -1, b = -1;
-	/*if (avl_node->left) a = avl_node->left->height;
-	if (avl_node->right) b = avl_node->right->height;
-	avl_node->height = max(a, b) + 1;*/
-	if (rc < 0) {
-		avl_node_t *curr = avl_node->left;
-		a = -1;
-		b = -1;
-		if (curr->left) a = curr->left->height;
-		if (curr->right) b = curr->right->height;
-		if (b - a == -2) {
-			a = -1;
-			b = -1;
-			if (curr->left->left) a = curr->left->left->height;
-			if (curr->left->right) b = curr->left->right->height;
-			if (b - a == -1) {
-				turn_right(avl_node, 0);
-			} else if (b - a == 1) {
-				turn_left(curr, 0);
-				turn_right(avl_node, 0);
-			}
-		} else if (b - a == 2) {
-			a = -1;
-			b = -1;
-			if (curr->right->left) a = curr->right->left->height;
-			if (curr->right->right) b = curr->right->right->height;
-			if (b - a == -1) {
-				turn_right(curr, 1);
-				turn_left(avl_node, 0);
-			} else if (b - a == 1) {
-				turn_left(avl_node, 0);
-			}
-		}
+		avl_node->right = __avl_tree_insert(avl_node->right, data, data_size, cmp, succes);
 	} else {
-		avl_node_t *curr = avl_node->right;
-		a = -1;
-		b = -1;
-		if (curr->left) a = curr->left->height;
-		if (curr->right) b = curr->right->height;
-		if (b - a == -2) {
-			a = -1;
-			b = -1;
-			if (curr->left->left) a = curr->left->left->height;
-			if (curr->left->right) b = curr->left->right->height;
-			if (b - a == -1) {
-				turn_right(avl_node, 1);
-			} else if (b - a == 1) {
-				turn_left(curr, 0);
-				turn_right(avl_node, 1);
-			}
-		} else if (b - a == 2) {
-			a = -1;
-			b = -1;
-			if (curr->right->left) a = curr->right->left->height;
-			if (curr->right->right) b = curr->right->right->height;
-			if (b - a == -1) {
-				turn_right(curr, 1);
-				turn_left(avl_node, 1);
-			} else if (b - a == 1) {
-				turn_left(avl_node, 1);
-			}
-		}
+		*succes = 1;
+		return avl_node;
 	}
-	a = -1, b = -1;
-	if (avl_node->left) a = avl_node->left->height;
-	if (avl_node->right) b = avl_node->right->height;
-	avl_node->height = max(a, b) + 1;
+	return __avl_rebalance(avl_node);
 }
 
+/**
+ * Insert a new element in a avl
+ * @avl_tree: the avl where to insert the new element
+ * @data: the data to be inserted in avl
+ */
+
 void avl_tree_insert(avl_tree_t *avl_tree, void *data) {
 	int succes = 0;
-	if (!avl_tree->root) {
-		avl_tree->size++;
-		avl_node_t *node = __avl_node_create(data, avl_tree->data_size);
-		avl_tree->root = node;
-		return;
-	}
-	__avl_tree_insert(avl_tree->root, data, avl_tree->data_size, avl_tree->cmp, &succes);
-	avl_node_t *curr = avl_tree->root;
-	int a = -1;
-	int b = -1;
-	if (curr->left) a = curr->left->height;
-	if (curr->right) b = curr->right->height;
-	if (b - a == -2) {
-		a = -1;
-		b = -1;
-		if (curr->left->left) a = curr->left->left->height;
-		if (curr->left->right) b = curr->left->right->height;
-		if (b - a == -1) {
-			turn_right(avl_tree, 2);
-		} else if (b - a == 1) {
-			turn_left(curr, 0);
-			turn_right(avl_tree, 2);
-		}
-	} else if (b - a == 2) {
-		a = -1;
-		b = -1;
-		if (curr->right->left) a = curr->right->left->height;
-		if (curr->right->right) b = curr->right->right->height;
-		if (b - a == -1) {
-			turn_right(curr, 1);
-			turn_left(avl_tree, 2);
-		} else if (b - a == 1) {
-			turn_left(avl_tree, 2);
-		}
-	}
-	a = -1, b = -1;
-	if (avl_tree->root->left) a = avl_tree->root->left->height;
-	if (avl_tree->root->right) b = avl_tree->root->right->height;
-	avl_tree->root->height = max(a, b) + 1;
+	avl_tree->root = __avl_tree_insert(avl_tree->root, data, avl_tree->data_size, avl_tree->cmp, &succes);
 	avl_tree->size += (1 - succes);
 }
 
+/**
+ * Helper function to unlink the greatest node of a subtree, rebalancing on the way back up
+ * @avl_node: the subtree's root
+ * @max: where to store the unlinked node
+ * @return: the new root of the subtree
+ */
+static avl_node_t *__avl_remove_max(avl_node_t *avl_node, avl_node_t **max) {
+	if (!avl_node->right) {
+		*max = avl_node;
+		return avl_node->left;
+	}
+	avl_node->right = __avl_remove_max(avl_node->right, max);
+	return __avl_rebalance(avl_node);
+}
+
 /**
  * Helper function to remove an element from a avl
  * @avl_node: the binary search subtree's root where to remove the element from
  * @data: the data that is contained by the node which has to be removed
- * @data_size: data size
  * @cmp: function used to compare the data contained by two nodes
+ * @succes: set to 1 if the element was not found
+ * @return: the new root of the subtree, rebalanced
  */
 
-void __avl_tree_remove(avl_node_t *avl_node, void *data, int data_size, int (*cmp)(const void *, const void *), void (*free_data)(void*), int track, int *succes) {
-	int rc = cmp(data, avl_node->data);
-	if (track == 0) {
-		if (rc < 0) {
-			avl_node_t *curr = avl_node->left;
-			if (!curr) {
-				*succes = 1;
-				return;
-			}
-			int rc2 = cmp(data, curr->data);
-			if (rc2) {
-				__avl_tree_remove(avl_node->left, data, data_size, cmp, free_data, 0, succes);
-			} else {
-				if (!curr->left&&!curr->right) {
-					free_data(curr->data);
-					free(curr);
-					avl_node->left = NULL;
-					int a = -1, b = -1;
-					if (avl_node->left) a = avl_node->left->height;
-					if (avl_node->right) b = avl_node->right->height;
-					avl_node->height = max(a, b) + 1;
-					return;
-				} else if (!curr->right) {
-					avl_node->left = curr->left;
-					free_data(curr->data);
-					free(curr);
-					int a = -1, b = -1;
-					if (avl_node->left) a = avl_node->left->height;
-					if (avl_node->right) b = avl_node->right->height;
-					avl_node->height = max(a, b) + 1;
-					return;
-				} else if (!curr->left) {
-					avl_node->left = curr->right;
-					free_data(curr->data);
-					free(curr);
-					int a = -1, b = -1;
-					if (avl_node->left) a = avl_node->left->height;
-					if (avl_node->right) b = avl_node->right->height;
-					avl_node->height = max(a, b) + 1;
-					return;
-				} else {
-					avl_node_t *it = curr->left;
-					if (it->right) {
-						while (it->right->right) {
-							it = it->right;
-						}
-						avl_node_t *temp = it->right;
-						it->right = it->right->left;
-						memcpy(curr->data, temp->data, data_size);
-						free_data(temp->data);
-						free(temp);
-					} else {
-						curr->left = it->left;
-						memcpy(curr->data, it->data, data_size);
-						free_data(it->data);
-						free(it);
-						printf("mata\n");
-					}
-					int a = -1, b = -1;
-					if (curr->left) a = curr->left->height;
-					if (curr->right) b = curr->right->height;
-					curr->height = max(a, b) + 1;
-					if (curr->left) __avl_tree_remove(curr->left, data, data_size, cmp, free_data, 1, succes);
-				}
-			}
-		} else if (rc > 0) {
-			avl_node_t *curr = avl_node->right;
-			if (!curr) {
-				*succes = 1;
-				return;
-			}
-			int rc2 = cmp(data, curr->data);
-			if (rc2) {
-				__avl_tree_remove(avl_node->right, data, data_size, cmp, free_data, 0, succes);
-			} else {
-				if (!curr->left&&!curr->right) {
-					free_data(curr->data);
-					free(curr);
-					avl_node->right = NULL;
-					int a = -1, b = -1;
-					if (avl_node->left) a = avl_node->left->height;
-					if (avl_node->right) b = avl_node->right->height;
-					avl_node->height = max(a, b) + 1;
-					return;
-				} else if (!curr->right) {
-					avl_node->right = curr->left;
-					free_data(curr->data);
-					free(curr);
-					int a = -1, b = -1;
-					if (avl_node->left) a = avl_node->left->height;
-					if (avl_node->right) b = avl_node->right->height;
-					avl_node->height = max(a, b) + 1;
-					return;
-				} else if (!curr->left) {
-					avl_node->right = curr->right;
-					free_data(curr->data);
-					free(curr);
-					int a = -1, b = -1;
-					if (avl_node->left) a = avl_node->left->height;
-					if (avl_node->right) b = avl_node->right->height;
-					avl_node->height = max(a, b) + 1;
-					return;
-				} else {
-					avl_node_t *it = curr->left;
-					if (it->right) {
-						while (it->right->right) {
-							it = it->right;
-						}
-						avl_node_t *temp = it->right;
-						it->right = it->right->left;
-						memcpy(curr->data, temp->data, data_size);
-						free_data(temp->data);
-						free(temp);
-					} else {
-						curr->left = it->left;
-						memcpy(curr->data, it->data, data_size);
-						free_data(it->data);
-						free(it);
-					}
-					int a = -1, b = -1;
-					if (curr->left) a = curr->left->height;
-					if (curr->right) b = curr->right->height;
-					curr->height = max(a, b) + 1;
-					if (curr->left) __avl_tree_remove(curr->left, data, data_size, cmp, free_data, 1, succes);
-				}
-			}
-		}
-	} else {
-		if (avl_node->right) {
-			__avl_tree_remove(avl_node->left, data, data_size, cmp, free_data, 1, succes);
-		}
+avl_node_t *__avl_tree_remove(avl_node_t *avl_node, void *data, int (*cmp)(const void *, const void *), void (*free_data)(void*), int *succes) {
+	if (!avl_node) {
+		*succes = 1;
+		return NULL;
 	}
-	// Code for rebalancing
-	int a = -1, b = -1;
-	/*if (avl_node->left) a = avl_node->left->height;
-	if (avl_node->right) b = avl_node->right->height;
-	avl_node->height = max(a, b) + 1;*/
+	int rc = cmp(data, avl_node->data);
 	if (rc < 0) {
-		avl_node_t *curr = avl_node->left;
-		a = -1;
-		b = -1;
-		if (curr->left) a = curr->left->height;
-		if (curr->right) b = curr->right->height;
-		if (b - a == -2) {
-			a = -1;
-			b = -1;
-			if (curr->left->left) a = curr->left->left->height;
-			if (curr->left->right) b = curr->left->right->height;
-			if (b - a == -1) {
-				turn_right(avl_node, 0);
-			} else if (b - a == 1) {
-				turn_left(curr, 0);
-				turn_right(avl_node, 0);
-			}
-		} else if (b - a == 2) {
-			a = -1;
-			b = -1;
-			if (curr->right->left) a = curr->right->left->height;
-			if (curr->right->right) b = curr->right->right->height;
-			if (b - a == -1) {
-				turn_right(curr, 1);
-				turn_left(avl_node, 0);
-			} else if (b - a == 1) {
-				turn_left(avl_node, 0);
-			}
-		}
+		avl_node->left = __avl_tree_remove(avl_node->left, data, cmp, free_data, succes);
+	} else if (rc > 0) {
+		avl_node->right = __avl_tree_remove(avl_node->right, data, cmp, free_data, succes);
 	} else {
-		avl_node_t *curr = avl_node->right;
-		a = -1;
-		b = -1;
-		if (curr->left) a = curr->left->height;
-		if (curr->right) b = curr->right->height;
-		if (b - a == -2) {
-			a = -1;
-			b = -1;
-			if (curr->left->left) a = curr->left->left->height;
-			if (curr->left->right) b = curr->left->right->height;
-			if (b - a == -1) {
-				turn_right(avl_node, 1);
-			} else if (b - a == 1) {
-				turn_left(curr, 0);
-				turn_right(avl_node, 1);
-			}
-		} else if (b - a == 2) {
-			a = -1;
-			b = -1;
-			if (curr->right->left) a = curr->right->left->height;
-			if (curr->right->right) b = curr->right->right->height;
-			if (b - a == -1) {
-				turn_right(curr, 1);
-				turn_left(avl_node, 1);
-			} else if (b - a == 1) {
-				turn_left(avl_node, 1);
-			}
+		avl_node_t *curr = avl_node;
+		if (!curr->left) {
+			avl_node = curr->right;
+		} else if (!curr->right) {
+			avl_node = curr->left;
+		} else {
+			// The predecessor takes the place of the removed node
+			curr->left = __avl_remove_max(curr->left, &avl_node);
+			avl_node->left = curr->left;
+			avl_node->right = curr->right;
 		}
+		free_data(curr->data);
+		free(curr);
+		if (!avl_node)
+			return NULL;
 	}
-	a = -1, b = -1;
-	if (avl_node->left) a = avl_node->left->height;
-	if (avl_node->right) b = avl_node->right->height;
-	avl_node->height = max(a, b) + 1;
+	return __avl_rebalance(avl_node);
 }
 
 /**
@@ -549,82 +292,8 @@ void __avl_tree_remove(avl_node_t *avl_node, void *data, int data_size, int (*cm
 void avl_tree_remove(avl_tree_t *avl_tree, void *data, void (*free_data)(void*))
 {
 	int succes = 0;
-	if (!avl_tree->root) {
-		return;
-	}
-	if (!avl_tree->cmp(data, avl_tree->root->data)) {
-		avl_node_t *curr = avl_tree->root;
-		if (!curr->left&&!curr->right) {
-			free_data(curr->data);
-			free(curr);
-			avl_tree->root = NULL;
-		} else if (!curr->right) {
-			avl_tree->root = curr->left;
-			free_data(curr->data);
-			free(curr);
-		} else if (!curr->left) {
-			avl_tree->root = curr->right;
-			free_data(curr->data);
-			free(curr);
-		} else {
-			avl_node_t *it = curr->left;
-			if (it->right) {
-				while (it->right->right) {
-					it = it->right;
-				}
-				avl_node_t *temp = it->right;
-				it->right = it->right->left;
-				memcpy(curr->data, temp->data, avl_tree->data_size);
-				free_data(temp->data);
-				free(temp);
-			} else {
-				curr->left = it->left;
-				memcpy(curr->data, it->data, avl_tree->data_size);
-				free_data(it->data);
-				free(it);
-			}
-			__avl_tree_remove(avl_tree->root->left, data, avl_tree->data_size, avl_tree->cmp, free_data, 1, &succes);
-		}
-	} else {
-		__avl_tree_remove(avl_tree->root, data, avl_tree->data_size, avl_tree->cmp, free_data, 0, &succes);
-	}
-
+	avl_tree->root = __avl_tree_remove(avl_tree->root, data, avl_tree->cmp, free_data, &succes);
 	avl_tree->size -= (1 - succes);
-
-	// Rebalance
-
-	avl_node_t *curr = avl_tree->root;
-	int a = -1;
-	int b = -1;
-	if (curr->left) a = curr->left->height;
-	if (curr->right) b = curr->right->height;
-	if (b - a == -2) {
-		a = -1;
-		b = -1;
-		if (curr->left->left) a = curr->left->left->height;
-		if (curr->left->right) b = curr->left->right->height;
-		if (b - a == -1) {
-			turn_right(avl_tree, 2);
-		} else if (b - a == 1) {
-			turn_left(curr, 0);
-			turn_right(avl_tree, 2);
-		}
-	} else if (b - a == 2) {
-		a = -1;
-		b = -1;
-		if (curr->right->left) a = curr->right->left->height;
-		if (curr->right->right) b = curr->right->right->height;
-		if (b - a == -1) {
-			turn_right(curr, 1);
-			turn_left(avl_tree, 2);
-		} else if (b - a == 1) {
-			turn_left(avl_tree, 2);
-		}
-	}
-	a = -1, b = -1;
-	if (avl_tree->root->left) a = avl_tree->root->left->height;
-	if (avl_tree->root->right) b = avl_tree->root->right->height;
-	avl_tree->root->height = max(a, b) + 1;
 }
 
 /**
@@ -683,6 +352,79 @@ int avl_has_key(avl_tree_t *avl_tree, void *data) {
 	return __avl_has_key(avl_tree->root, data, avl_tree->cmp);
 }
 
+/**
+ * Find the k-th smallest element of a avl, using the subtree sizes
+ * @avl_tree: the avl to search in
+ * @k: position of the element in sorted order, starting from 0
+ * @return: the data of that element, or NULL if k is out of range
+ */
+void *avl_select(avl_tree_t *avl_tree, int k)
+{
+	avl_node_t *curr = avl_tree->root;
+
+	if (k < 0 || k >= __avl_size(curr))
+		return NULL;
+
+	while (curr) {
+		int left = __avl_size(curr->left);
+		if (k < left) {
+			curr = curr->left;
+		} else if (k > left) {
+			k -= left + 1;
+			curr = curr->right;
+		} else {
+			return curr->data;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Helper function to count the elements smaller than data (or equal to it,
+ * if inclusive is set)
+ */
+static int __avl_rank(avl_node_t *avl_node, void *data, int (*cmp)(const void*, const void*), int inclusive)
+{
+	int rank = 0;
+
+	while (avl_node) {
+		int rc = cmp(data, avl_node->data);
+		if (rc < 0 || (rc == 0 && !inclusive)) {
+			avl_node = avl_node->left;
+		} else {
+			rank += __avl_size(avl_node->left) + 1;
+			avl_node = avl_node->right;
+		}
+	}
+	return rank;
+}
+
+/**
+ * Rank of data in a avl
+ * @avl_tree: the avl to search in
+ * @data: the data to look for (it does not have to be in the avl)
+ * @return: the number of elements smaller than data
+ */
+int avl_rank(avl_tree_t *avl_tree, void *data)
+{
+	return __avl_rank(avl_tree->root, data, avl_tree->cmp, 0);
+}
+
+/**
+ * Count the elements of a avl between two keys
+ * @avl_tree: the avl to search in
+ * @lo: lower bound (inclusive)
+ * @hi: upper bound (inclusive)
+ * @return: the number of elements e with lo <= e <= hi
+ */
+int avl_count_range(avl_tree_t *avl_tree, void *lo, void *hi)
+{
+	if (avl_tree->cmp(lo, hi) > 0)
+		return 0;
+	return __avl_rank(avl_tree->root, hi, avl_tree->cmp, 1) -
+		__avl_rank(avl_tree->root, lo, avl_tree->cmp, 0);
+}
+
 /**
  * Print inorder a avl
  * @avl_tree: the avl to be printed
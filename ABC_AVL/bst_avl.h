@@ -52,6 +52,9 @@ struct  avl_node_t {
 	void *data;
 
 	unsigned char height;
+
+	/* number of nodes in the subtree rooted here */
+	int size;
 };
 
 typedef struct avl_tree_t avl_tree_t;
@@ -81,13 +84,16 @@ avl_tree_t *avl_tree_create(size_t data_size,
 	int (*cmp_f)(const void *, const void *));
 void turn_right(void *ptr, char side);
 void turn_left(void *ptr, char side);
-void __avl_tree_insert(avl_node_t *avl_node, void *data, int data_size, int (*cmp)(const void *key1, const void *key2), int *succes);
+avl_node_t *__avl_tree_insert(avl_node_t *avl_node, void *data, int data_size, int (*cmp)(const void *key1, const void *key2), int *succes);
 void avl_tree_insert(avl_tree_t *avl_tree, void *data);
-void __avl_tree_remove(avl_node_t *avl_node, void *data, int data_size, int (*cmp)(const void *, const void *), void (*free_data)(void*), int track, int *succes);
+avl_node_t *__avl_tree_remove(avl_node_t *avl_node, void *data, int (*cmp)(const void *, const void *), void (*free_data)(void*), int *succes);
 void avl_tree_remove(avl_tree_t *avl_tree, void *data, void (*free_data)(void*));
 void avl_tree_free(avl_tree_t *avl_tree, void (*free_data)(void *));
 int __avl_has_key(avl_node_t *avl_node, void *data, int (*cmp)(const void*, const void*));
 int avl_has_key(avl_tree_t *avl_tree, void *data);
+void *avl_select(avl_tree_t *avl_tree, int k);
+int avl_rank(avl_tree_t *avl_tree, void *data);
+int avl_count_range(avl_tree_t *avl_tree, void *lo, void *hi);
 void avl_tree_print_inorder(avl_tree_t* avl_tree, void (*print_data)(void*));
 
 
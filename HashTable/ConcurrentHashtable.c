@@ -0,0 +1,161 @@
+#include "ConcurrentHashtable.h"
+
+/*
+ * Hashtable pentru mai multe thread-uri, cu lock striping: cheile sunt
+ * impartite intre n_shards hashtable_t-uri independente, fiecare cu propriul
+ * rwlock. Citirile din acelasi shard ruleaza in paralel (read lock), iar
+ * scrierile blocheaza doar shard-ul cheii lor.
+ */
+
+/*
+ * Alege shard-ul unei chei din bitii superiori ai hash-ului amestecat
+ * (Fibonacci hashing), ca alegerea sa nu depinda de bitii inferiori folositi
+ * deja pentru bucket-ul din interiorul shard-ului. Hash-ul este calculat o
+ * singura data de apelant si transmis mai departe shard-ului (ht_*_hashed).
+ */
+static inline cht_shard_t *__cht_shard(conc_hashtable_t *cht,
+	unsigned int hash)
+{
+	if (cht->shard_bits == 0)
+		return &cht->shards[0];
+
+	unsigned int mixed = hash * 0x9E3779B1u;
+	return &cht->shards[mixed >> (32 - cht->shard_bits)];
+}
+
+/*
+ * Functie apelata pentru a aloca si initializa un hashtable concurent cu
+ * n_shards shard-uri (CHT_SHARDS daca n_shards este 0), fiecare pornind cu
+ * hmax bucket-uri.
+ */
+conc_hashtable_t *cht_create(unsigned int n_shards, unsigned int hmax,
+		unsigned int (*hash_function)(void*),
+		int (*compare_function)(void*, void*),
+		void (*key_val_free_function)(void*))
+{
+	conc_hashtable_t *cht = calloc(1, sizeof(conc_hashtable_t));
+	DIE(cht == NULL, "cht calloc");
+
+	if (n_shards == 0)
+		n_shards = CHT_SHARDS;
+	cht->n_shards = 1;
+	while (cht->n_shards < n_shards) {
+		cht->n_shards <<= 1;
+		cht->shard_bits++;
+	}
+	cht->hash_function = hash_function;
+
+	cht->shards = aligned_alloc(64, cht->n_shards * sizeof(cht_shard_t));
+	DIE(cht->shards == NULL, "cht shards aligned_alloc");
+	for (unsigned int i = 0; i < cht->n_shards; i++) {
+		DIE(pthread_rwlock_init(&cht->shards[i].lock, NULL) != 0,
+			"cht pthread_rwlock_init");
+		cht->shards[i].ht = ht_create(hmax, hash_function, compare_function,
+			key_val_free_function);
+	}
+
+	return cht;
+}
+
+/*
+ * Functie care intoarce:
+ * 1, daca pentru cheia key a fost asociata anterior o valoare in hashtable
+ * folosind functia put;
+ * 0, altfel.
+ */
+int cht_has_key(conc_hashtable_t *cht, void *key)
+{
+	unsigned int hash = cht->hash_function(key);
+	cht_shard_t *shard = __cht_shard(cht, hash);
+
+	pthread_rwlock_rdlock(&shard->lock);
+	int found = ht_lookup_hashed(shard->ht, key, hash) != NULL;
+	pthread_rwlock_unlock(&shard->lock);
+
+	return found;
+}
+
+/*
+ * Atentie! Spre deosebire de ht_get, valoarea este copiata (cel mult
+ * value_size octeti) in bufferul value cat timp shard-ul este blocat: un
+ * pointer in tabela ar putea fi eliberat de un alt thread imediat dupa
+ * deblocare. Functia intoarce 1 daca cheia a fost gasita si 0 altfel.
+ *
+ * Se foloseste ht_lookup_hashed, care nu avanseaza rehash-ul incremental,
+ * pentru ca mai multe thread-uri pot citi simultan acelasi shard.
+ */
+int cht_get(conc_hashtable_t *cht, void *key, void *value,
+	unsigned int value_size)
+{
+	unsigned int hash = cht->hash_function(key);
+	cht_shard_t *shard = __cht_shard(cht, hash);
+
+	pthread_rwlock_rdlock(&shard->lock);
+	info *entry = ht_lookup_hashed(shard->ht, key, hash);
+	if (entry != NULL) {
+		if (value_size > entry->value_size)
+			value_size = entry->value_size;
+		memcpy(value, entry->value, value_size);
+	}
+	pthread_rwlock_unlock(&shard->lock);
+
+	return entry != NULL;
+}
+
+void cht_put(conc_hashtable_t *cht, void *key, unsigned int key_size,
+	void *value, unsigned int value_size)
+{
+	unsigned int hash = cht->hash_function(key);
+	cht_shard_t *shard = __cht_shard(cht, hash);
+
+	pthread_rwlock_wrlock(&shard->lock);
+	ht_put_hashed(shard->ht, key, hash, key_size, value, value_size);
+	pthread_rwlock_unlock(&shard->lock);
+}
+
+void cht_remove_entry(conc_hashtable_t *cht, void *key)
+{
+	unsigned int hash = cht->hash_function(key);
+	cht_shard_t *shard = __cht_shard(cht, hash);
+
+	pthread_rwlock_wrlock(&shard->lock);
+	ht_remove_entry_hashed(shard->ht, key, hash);
+	pthread_rwlock_unlock(&shard->lock);
+}
+
+/*
+ * Procedura care elibereaza memoria folosita de toate shard-urile. Nu trebuie
+ * apelata cat timp alte thread-uri mai folosesc tabela.
+ */
+void cht_free(conc_hashtable_t *cht)
+{
+	if (cht == NULL)
+		return;
+
+	for (unsigned int i = 0; i < cht->n_shards; i++) {
+		ht_free(cht->shards[i].ht);
+		pthread_rwlock_destroy(&cht->shards[i].lock);
+	}
+	free(cht->shards);
+	free(cht);
+}
+
+/*
+ * Intoarce suma dimensiunilor shard-urilor. Shard-urile sunt citite pe rand,
+ * deci rezultatul este exact doar daca nu au loc scrieri concurente.
+ */
+unsigned int cht_get_size(conc_hashtable_t *cht)
+{
+	unsigned int size = 0;
+
+	if (cht == NULL)
+		return 0;
+
+	for (unsigned int i = 0; i < cht->n_shards; i++) {
+		pthread_rwlock_rdlock(&cht->shards[i].lock);
+		size += ht_get_size(cht->shards[i].ht);
+		pthread_rwlock_unlock(&cht->shards[i].lock);
+	}
+
+	return size;
+}
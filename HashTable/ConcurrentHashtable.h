@@ -0,0 +1,46 @@
+#ifndef __CONCURRENT_HASHTABLE_H_
+#define __CONCURRENT_HASHTABLE_H_
+
+#include <pthread.h>
+
+#include "Hashtable.h"
+
+/* Nr. implicit de shard-uri (rotunjit oricum la o putere a lui 2). */
+#define CHT_SHARDS 16
+
+/*
+ * Un shard: un hashtable_t obisnuit protejat de propriul rwlock. Structura este
+ * aliniata la 64 de octeti ca doua shard-uri vecine sa nu imparta o linie de
+ * cache.
+ */
+typedef struct cht_shard_t cht_shard_t;
+struct cht_shard_t {
+	pthread_rwlock_t lock;
+	hashtable_t *ht;
+} __attribute__((aligned(64)));
+
+typedef struct conc_hashtable_t conc_hashtable_t;
+struct conc_hashtable_t {
+	/* Vectorul de shard-uri; o cheie apartine mereu aceluiasi shard. */
+	cht_shard_t *shards;
+	/* Nr. de shard-uri (putere a lui 2) si log2 al acestuia. */
+	unsigned int n_shards;
+	unsigned int shard_bits;
+	/* (Pointer la) Functie pentru a calcula valoarea hash asociata cheilor. */
+	unsigned int (*hash_function)(void*);
+};
+
+conc_hashtable_t *cht_create(unsigned int n_shards, unsigned int hmax,
+		unsigned int (*hash_function)(void*),
+		int (*compare_function)(void*, void*),
+		void (*key_val_free_function)(void*));
+int cht_has_key(conc_hashtable_t *cht, void *key);
+int cht_get(conc_hashtable_t *cht, void *key, void *value,
+	unsigned int value_size);
+void cht_put(conc_hashtable_t *cht, void *key, unsigned int key_size,
+	void *value, unsigned int value_size);
+void cht_remove_entry(conc_hashtable_t *cht, void *key);
+void cht_free(conc_hashtable_t *cht);
+unsigned int cht_get_size(conc_hashtable_t *cht);
+
+#endif
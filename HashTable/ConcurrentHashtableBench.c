@@ -0,0 +1,125 @@
+/*
+ * Benchmark de scalabilitate pentru conc_hashtable_t: pentru 1, 2, 4, ..., 64
+ * de thread-uri, fiecare thread face BENCH_OPS operatii pe chei aleatoare
+ * (BENCH_PUT_PERCENT% put, restul get) si se afiseaza debitul total. Ca
+ * referinta, acelasi test ruleaza si pe un singur hashtable_t protejat de un
+ * mutex global.
+ *
+ * Compilare si rulare (din HashTable/):
+ *	gcc -O2 -pthread ConcurrentHashtableBench.c ConcurrentHashtable.c \
+ *		Hashtable.c -o cht_bench
+ *	./cht_bench [operatii_per_thread]
+ */
+#include <time.h>
+
+#include "ConcurrentHashtable.h"
+
+#define BENCH_KEYS (1 << 20)
+#define BENCH_OPS 1000000
+#define BENCH_PUT_PERCENT 10
+#define BENCH_MAX_THREADS 64
+
+typedef struct bench_arg_t bench_arg_t;
+struct bench_arg_t {
+	/* Exact unul dintre cele doua este folosit. */
+	conc_hashtable_t *cht;
+	hashtable_t *ht;
+	pthread_mutex_t *lock;
+
+	unsigned int seed;
+	unsigned int ops;
+};
+
+/* Generator xorshift32, cate unul pe thread. */
+static inline unsigned int __bench_rand(unsigned int *state)
+{
+	unsigned int x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+static void *__bench_worker(void *arg)
+{
+	bench_arg_t *b = (bench_arg_t*)arg;
+	unsigned int state = b->seed;
+
+	for (unsigned int i = 0; i < b->ops; i++) {
+		unsigned int r = __bench_rand(&state);
+		int key = r % BENCH_KEYS, value;
+		int put = (r >> 24) % 100 < BENCH_PUT_PERCENT;
+
+		if (b->cht != NULL) {
+			if (put)
+				cht_put(b->cht, &key, sizeof(key), &key, sizeof(key));
+			else
+				cht_get(b->cht, &key, &value, sizeof(value));
+		} else {
+			pthread_mutex_lock(b->lock);
+			if (put)
+				ht_put(b->ht, &key, sizeof(key), &key, sizeof(key));
+			else
+				ht_get(b->ht, &key);
+			pthread_mutex_unlock(b->lock);
+		}
+	}
+
+	return NULL;
+}
+
+/* Ruleaza testul cu n_threads thread-uri si intoarce debitul in Mops/s. */
+static double __bench_run(conc_hashtable_t *cht, hashtable_t *ht,
+	unsigned int n_threads, unsigned int ops)
+{
+	pthread_t threads[BENCH_MAX_THREADS];
+	bench_arg_t args[BENCH_MAX_THREADS];
+	pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+	struct timespec start, end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (unsigned int i = 0; i < n_threads; i++) {
+		args[i].cht = cht;
+		args[i].ht = ht;
+		args[i].lock = &lock;
+		args[i].seed = 2463534242u + i * 0x9E3779B9u;
+		args[i].ops = ops;
+		DIE(pthread_create(&threads[i], NULL, __bench_worker, &args[i]) != 0,
+			"pthread_create");
+	}
+	for (unsigned int i = 0; i < n_threads; i++)
+		pthread_join(threads[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	double seconds = (end.tv_sec - start.tv_sec) +
+		(end.tv_nsec - start.tv_nsec) / 1e9;
+	return (double)n_threads * ops / seconds / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int ops = BENCH_OPS;
+
+	if (argc > 1)
+		ops = strtoul(argv[1], NULL, 10);
+
+	conc_hashtable_t *cht = cht_create(0, HMAX, hash_function_int,
+		compare_function_ints, key_val_free_function);
+	hashtable_t *ht = ht_create(HMAX, hash_function_int,
+		compare_function_ints, key_val_free_function);
+	for (int key = 0; key < BENCH_KEYS; key++) {
+		cht_put(cht, &key, sizeof(key), &key, sizeof(key));
+		ht_put(ht, &key, sizeof(key), &key, sizeof(key));
+	}
+
+	printf("%8s %16s %16s\n", "threads", "cht (Mops/s)", "mutex (Mops/s)");
+	for (unsigned int n = 1; n <= BENCH_MAX_THREADS; n <<= 1)
+		printf("%8u %16.2f %16.2f\n", n, __bench_run(cht, NULL, n, ops),
+			__bench_run(NULL, ht, n, ops));
+
+	cht_free(cht);
+	ht_free(ht);
+	return 0;
+}
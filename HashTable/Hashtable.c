@@ -1,4 +1,23 @@
-#include "utils.h"
+#include <fcntl.h>
+#include <stddef.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "Hashtable.h"
+
+/*
+ * Contoarele din ht_stats exista doar cand HT_STATS este definit la
+ * compilare; altfel HT_STAT_ADD nu genereaza niciun cod. Incrementarile sunt
+ * atomice (relaxed) pentru ca ht_lookup poate rula in paralel pe mai multe
+ * thread-uri (vezi ConcurrentHashtable).
+ */
+#ifdef HT_STATS
+#define HT_STAT_ADD(ht, field, n) \
+	__atomic_fetch_add(&(ht)->stats.field, (n), __ATOMIC_RELAXED)
+#else
+#define HT_STAT_ADD(ht, field, n) do { } while (0)
+#endif
 
 linked_list_t *ll_create(unsigned int data_size) {
     linked_list_t* ll;
@@ -226,6 +245,127 @@ unsigned int hash_function_string(void *a) {
 	return hash;
 }
 
+/*
+ * Functie de hashing cu seed pentru chei binare de len octeti (nu presupune
+ * terminatorul '\0'), in stilul wyhash: cheia este citita cate 8 octeti, iar
+ * cuvintele sunt amestecate prin inmultiri 64x64 -> 128 de biti. Cheile lungi
+ * sunt procesate pe trei fluxuri independente de cate 16 octeti, ca
+ * inmultirile sa se poata suprapune in procesor.
+ */
+#define __HB_P0 0xa0761d6478bd642full
+#define __HB_P1 0xe7037ed1a0b428dbull
+#define __HB_P2 0x8ebc6af09c88c6e3ull
+#define __HB_P3 0x589965cc75374cc3ull
+
+static inline unsigned long long __hb_mix(unsigned long long a,
+	unsigned long long b)
+{
+#if defined(__SIZEOF_INT128__)
+	__uint128_t r = (__uint128_t)a * b;
+	return (unsigned long long)r ^ (unsigned long long)(r >> 64);
+#else
+	unsigned long long ha = a >> 32, la = (unsigned int)a;
+	unsigned long long hb = b >> 32, lb = (unsigned int)b;
+	unsigned long long rh = ha * hb, rm0 = ha * lb, rm1 = hb * la;
+	unsigned long long rl = la * lb, t = rl + (rm0 << 32);
+	unsigned long long lo = t + (rm1 << 32);
+	unsigned long long hi = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl) +
+		(lo < t);
+	return lo ^ hi;
+#endif
+}
+
+static inline unsigned long long __hb_read8(const unsigned char *p)
+{
+	unsigned long long v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline unsigned long long __hb_read4(const unsigned char *p)
+{
+	unsigned int v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+unsigned long long hash_bytes(const void *data, size_t len,
+	unsigned long long seed)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	unsigned long long a, b;
+
+	seed ^= __hb_mix(seed ^ __HB_P0, __HB_P1);
+	if (len <= 16) {
+		if (len >= 4) {
+			size_t off = (len >> 3) << 2;
+			a = (__hb_read4(p) << 32) | __hb_read4(p + off);
+			b = (__hb_read4(p + len - 4) << 32) |
+				__hb_read4(p + len - 4 - off);
+		} else if (len > 0) {
+			a = ((unsigned long long)p[0] << 16) |
+				((unsigned long long)p[len >> 1] << 8) | p[len - 1];
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		size_t i = len;
+		if (i > 48) {
+			unsigned long long see1 = seed, see2 = seed;
+			do {
+				seed = __hb_mix(__hb_read8(p) ^ __HB_P1,
+					__hb_read8(p + 8) ^ seed);
+				see1 = __hb_mix(__hb_read8(p + 16) ^ __HB_P2,
+					__hb_read8(p + 24) ^ see1);
+				see2 = __hb_mix(__hb_read8(p + 32) ^ __HB_P3,
+					__hb_read8(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= see1 ^ see2;
+		}
+		while (i > 16) {
+			seed = __hb_mix(__hb_read8(p) ^ __HB_P1,
+				__hb_read8(p + 8) ^ seed);
+			p += 16;
+			i -= 16;
+		}
+		a = __hb_read8(p + i - 16);
+		b = __hb_read8(p + i - 8);
+	}
+
+	return __hb_mix(__hb_mix(a ^ __HB_P1, b ^ seed) ^ __HB_P0 ^ len,
+		__HB_P1 ^ seed);
+}
+
+/*
+ * Intoarce un seed aleator pentru hash_bytes, citit din /dev/urandom (sau,
+ * daca acesta nu poate fi citit, derivat din timp si din adrese), astfel incat
+ * coliziunile unei tabele sa nu poata fi prezise din afara.
+ */
+unsigned long long hash_random_seed(void)
+{
+	unsigned long long seed = 0;
+	int fd = open("/dev/urandom", O_RDONLY);
+
+	if (fd >= 0) {
+		if (read(fd, &seed, sizeof(seed)) != sizeof(seed))
+			seed = 0;
+		close(fd);
+	}
+
+	if (seed == 0) {
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		seed = __hb_mix((unsigned long long)ts.tv_nsec ^ __HB_P2,
+			(unsigned long long)ts.tv_sec ^
+			(unsigned long long)(size_t)&seed);
+	}
+
+	return seed;
+}
+
 /*
  * Functie apelata pentru a elibera memoria ocupata de cheia si valoarea unei
  * perechi din hashtable. Daca cheia sau valoarea contin tipuri de date complexe
@@ -237,26 +377,481 @@ void key_val_free_function(void *data) {
 	free(data);
 }
 
+/*
+ * Alocatorul arena (optional, vezi ht_enable_arena). Fiecare intrare ocupa un
+ * singur bloc: nodul din lista, structura info, cheia si valoarea, una dupa
+ * alta. Blocurile sunt taiate din chunk-uri mari de HT_ARENA_CHUNK octeti,
+ * obtinute cu mmap (cu huge pages, unde sistemul le ofera), si sunt rotunjite
+ * la multipli de 16 octeti. Blocurile eliberate ajung intr-o lista libera per
+ * dimensiune si sunt refolosite; chunk-urile sunt eliberate toate deodata de
+ * ht_free. Blocurile mai mari de HT_ARENA_CLASSES * 16 octeti sunt alocate
+ * separat, cu malloc.
+ */
+typedef struct ht_arena_entry_t ht_arena_entry_t;
+struct ht_arena_entry_t {
+	ll_node_t node;
+	info entry;
+	/* Dimensiunea blocului, din care se deduce capacitatea valorii inline. */
+	unsigned int block_size;
+};
+
+#define __HT_ALIGN8(x) (((x) + 7u) & ~7u)
+#define __HT_ARENA_ENTRY(data) \
+	((ht_arena_entry_t*)((char*)(data) - offsetof(ht_arena_entry_t, entry)))
+
+static inline unsigned char *__ht_arena_key(ht_arena_entry_t *e)
+{
+	return (unsigned char*)e + __HT_ALIGN8(sizeof(ht_arena_entry_t));
+}
+
+static inline unsigned char *__ht_arena_value(ht_arena_entry_t *e)
+{
+	return __ht_arena_key(e) + __HT_ALIGN8(e->entry.key_size);
+}
+
+static void *__ht_arena_alloc(ht_arena_t *arena, unsigned int block_size)
+{
+	unsigned int cls = block_size / 16 - 1;
+
+	if (cls >= HT_ARENA_CLASSES) {
+		void *block = malloc(block_size);
+		DIE(block == NULL, "ht arena block malloc");
+		arena->bytes += block_size;
+		return block;
+	}
+
+	if (arena->free_lists[cls] != NULL) {
+		void *block = arena->free_lists[cls];
+		arena->free_lists[cls] = *(void**)block;
+		return block;
+	}
+
+	if (arena->left < block_size) {
+		void **chunk = mmap(NULL, HT_ARENA_CHUNK, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		DIE(chunk == MAP_FAILED, "ht arena mmap");
+#ifdef MADV_HUGEPAGE
+		madvise(chunk, HT_ARENA_CHUNK, MADV_HUGEPAGE);
+#endif
+		/* Primul cuvant din chunk inlantuie chunk-urile. */
+		*chunk = arena->chunks;
+		arena->chunks = chunk;
+		arena->cursor = (unsigned char*)chunk + 16;
+		arena->left = HT_ARENA_CHUNK - 16;
+		arena->bytes += HT_ARENA_CHUNK;
+	}
+
+	void *block = arena->cursor;
+	arena->cursor += block_size;
+	arena->left -= block_size;
+	return block;
+}
+
+static void __ht_arena_release(ht_arena_t *arena, void *block,
+	unsigned int block_size)
+{
+	unsigned int cls = block_size / 16 - 1;
+
+	if (cls >= HT_ARENA_CLASSES) {
+		free(block);
+		arena->bytes -= block_size;
+		return;
+	}
+
+	*(void**)block = arena->free_lists[cls];
+	arena->free_lists[cls] = block;
+}
+
+/*
+ * Elibereaza toate chunk-urile arenei, impreuna cu toate blocurile din ele.
+ */
+static void __ht_arena_destroy(ht_arena_t *arena)
+{
+	void **chunk = arena->chunks;
+
+	while (chunk != NULL) {
+		void **next = *chunk;
+		munmap(chunk, HT_ARENA_CHUNK);
+		chunk = next;
+	}
+	free(arena);
+}
+
+/*
+ * Calculeaza hash-ul unei chei: cu hash_bytes_function (si seed-ul tabelei)
+ * pentru tabelele create cu ht_create_seeded, altfel cu hash_function.
+ */
+static inline unsigned int __ht_hash(hashtable_t *ht, void *key)
+{
+	if (ht->hash_bytes_function == NULL)
+		return ht->hash_function(key);
+
+	size_t len = ht->key_size ? ht->key_size : strlen((char*)key);
+	return (unsigned int)ht->hash_bytes_function(key, len, ht->seed);
+}
+
+/*
+ * Intoarce lista in care se afla (sau ar trebui inserata) o cheie cu valoarea
+ * hash data. Cat timp un rehash este in desfasurare, bucket-urile din
+ * old_buckets cu index >= rehash_idx nu au fost inca mutate, deci cheile lor
+ * se cauta tot acolo.
+ */
+static linked_list_t **__ht_bucket(hashtable_t *ht, unsigned int hash)
+{
+	if (ht->old_buckets) {
+		unsigned int old_index = hash & (ht->old_hmax - 1);
+		if (old_index >= ht->rehash_idx)
+			return &ht->old_buckets[old_index];
+	}
+
+	return &ht->buckets[hash & (ht->hmax - 1)];
+}
+
+/*
+ * Muta (fara realocari) nodurile unui bucket din old_buckets in tabela noua.
+ */
+static void __ht_migrate_bucket(hashtable_t *ht, unsigned int old_index)
+{
+	linked_list_t *old = ht->old_buckets[old_index];
+
+	if (old == NULL)
+		return;
+
+	while (old->head != NULL) {
+		ll_node_t *node = old->head;
+		old->head = node->next;
+
+		unsigned int index = ((info*)node->data)->hash & (ht->hmax - 1);
+		if (ht->buckets[index] == NULL)
+			ht->buckets[index] = ll_create(sizeof(info));
+		node->next = ht->buckets[index]->head;
+		ht->buckets[index]->head = node;
+		ht->buckets[index]->size++;
+	}
+
+	free(old);
+	ht->old_buckets[old_index] = NULL;
+}
+
+/*
+ * Un pas de rehash incremental: muta cel mult HT_REHASH_STEP bucket-uri
+ * nevide (si viziteaza cel mult de 10 ori mai multe bucket-uri goale), astfel
+ * incat costul redimensionarii este impartit intre operatiile put/get.
+ */
+static void __ht_rehash_step(hashtable_t *ht)
+{
+	unsigned int moved = 0, visited = 0;
+
+	if (ht->old_buckets == NULL)
+		return;
+
+	while (ht->rehash_idx < ht->old_hmax && moved < HT_REHASH_STEP &&
+		visited < 10 * HT_REHASH_STEP) {
+		if (ht->old_buckets[ht->rehash_idx]) {
+			__ht_migrate_bucket(ht, ht->rehash_idx);
+			moved++;
+		}
+		visited++;
+		ht->rehash_idx++;
+	}
+
+	if (ht->rehash_idx == ht->old_hmax) {
+		free(ht->old_buckets);
+		ht->old_buckets = NULL;
+		ht->old_hmax = 0;
+		ht->rehash_idx = 0;
+	}
+}
+
+/*
+ * Porneste redimensionarea tabelei la hmax bucket-uri. Daca un rehash anterior
+ * nu s-a terminat inca, acesta este finalizat inainte.
+ */
+static void __ht_resize(hashtable_t *ht, unsigned int hmax)
+{
+	while (ht->old_buckets)
+		__ht_rehash_step(ht);
+
+	HT_STAT_ADD(ht, rehashes, 1);
+	ht->old_buckets = ht->buckets;
+	ht->old_hmax = ht->hmax;
+	ht->rehash_idx = 0;
+
+	ht->buckets = calloc(hmax, sizeof(linked_list_t*));
+	DIE(ht->buckets == NULL, "ht buckets calloc");
+	ht->hmax = hmax;
+}
+
+/*
+ * Verifica factorul de incarcare dupa o inserare sau o stergere. Tabela se
+ * dubleaza cand are mai mult de HT_MAX_LOAD intrari per bucket si, daca
+ * auto_shrink este activ, se injumatateste cand are mai putin de o intrare la
+ * HT_MIN_LOAD_DIV bucket-uri (fara a scadea sub hmax-ul initial).
+ */
+static void __ht_check_load(hashtable_t *ht)
+{
+	if (ht->old_buckets)
+		return;
+
+	if (ht->size > ht->hmax * HT_MAX_LOAD)
+		__ht_resize(ht, ht->hmax * 2);
+	else if (ht->auto_shrink && ht->hmax > ht->min_hmax &&
+		ht->size * HT_MIN_LOAD_DIV < ht->hmax)
+		__ht_resize(ht, ht->hmax / 2);
+}
+
 /*
  * Functie apelata dupa alocarea unui hashtable pentru a-l initializa.
- * Trebuie alocate si initializate si listele inlantuite.
+ * Nr. de bucket-uri este rotunjit la o putere a lui 2, iar listele
+ * inlantuite sunt create doar la prima inserare in bucket-ul respectiv.
  */
 hashtable_t *ht_create(unsigned int hmax, unsigned int (*hash_function)(void*),
 		int (*compare_function)(void*, void*),
 		void (*key_val_free_function)(void*))
 {
 	hashtable_t *curent = calloc(1, sizeof(hashtable_t));
-	DIE(curent, "Failed allocation");
-	for (int i = 0; i < hmax; i++) {
-		curent->buckets[i] = ll_create(sizeof(info));
-		DIE(curent, "Failed allocation");
-	}
+	DIE(curent == NULL, "Failed allocation");
+
+	unsigned int cap = 1;
+	while (cap < hmax)
+		cap <<= 1;
+
+	curent->buckets = calloc(cap, sizeof(linked_list_t*));
+	DIE(curent->buckets == NULL, "Failed allocation");
+	curent->hmax = cap;
+	curent->min_hmax = cap;
 	curent->hash_function = hash_function;
 	curent->key_val_free_function = key_val_free_function;
 	curent->compare_function = compare_function;
 	return curent;
 }
 
+/*
+ * La fel ca ht_create, dar cheile sunt hash-uite cu hash_bytes_function (sau
+ * cu hash_bytes, daca este NULL) si un seed aleator propriu tabelei. Daca
+ * key_size este 0, cheile sunt siruri terminate cu '\0'; altfel, fiecare
+ * cheie are exact key_size octeti si poate contine orice valori.
+ */
+hashtable_t *ht_create_seeded(unsigned int hmax, unsigned int key_size,
+		unsigned long long (*hash_bytes_function)(const void*, size_t,
+			unsigned long long),
+		int (*compare_function)(void*, void*),
+		void (*key_val_free_function)(void*))
+{
+	hashtable_t *curent = ht_create(hmax, NULL, compare_function,
+		key_val_free_function);
+
+	curent->key_size = key_size;
+	curent->hash_bytes_function = hash_bytes_function ? hash_bytes_function
+		: hash_bytes;
+	curent->seed = hash_random_seed();
+	return curent;
+}
+
+/*
+ * Trece tabela (inca goala) pe alocatorul arena: fiecare intrare noua este
+ * plasata intr-un singur bloc, iar ht_free elibereaza toate blocurile deodata.
+ * Atentie! Cheile si valorile sunt copii plate, in interiorul blocului, deci
+ * key_val_free_function nu mai este apelata pentru intrarile acestei tabele.
+ */
+void ht_enable_arena(hashtable_t *ht)
+{
+	DIE(ht->size != 0, "ht_enable_arena on a non-empty table");
+
+	if (ht->arena != NULL)
+		return;
+
+	ht->arena = calloc(1, sizeof(ht_arena_t));
+	DIE(ht->arena == NULL, "ht arena calloc");
+}
+
+/*
+ * Activeaza (enable = 1) sau dezactiveaza micsorarea automata a tabelei dupa
+ * stergeri. Implicit, tabela doar creste.
+ */
+void ht_set_auto_shrink(hashtable_t *ht, int enable)
+{
+	ht->auto_shrink = enable;
+}
+
+/*
+ * Cauta cheia key (cu valoarea hash deja calculata) intr-o singura trecere prin
+ * bucket-ul ei. Cheile sunt comparate doar cand hash-ul memorat in info
+ * coincide. Intoarce nodul gasit (sau NULL); prin bucket si prev (daca nu sunt
+ * NULL) intoarce si lista in care se afla cheia, respectiv nodul de dinainte.
+ */
+static ll_node_t *__ht_find(hashtable_t *ht, void *key, unsigned int hash,
+	linked_list_t ***bucket, ll_node_t **prev)
+{
+	linked_list_t **list = __ht_bucket(ht, hash);
+	ll_node_t *before = NULL, *iterator = NULL;
+
+	if (*list != NULL)
+		iterator = (*list)->head;
+
+	while (iterator != NULL) {
+		info *curr = (info*)iterator->data;
+		HT_STAT_ADD(ht, probes, 1);
+		if (curr->hash == hash && !ht->compare_function(key, curr->key))
+			break;
+		before = iterator;
+		iterator = iterator->next;
+	}
+
+	if (bucket)
+		*bucket = list;
+	if (prev)
+		*prev = before;
+	return iterator;
+}
+
+/*
+ * Copiaza valoarea in intrarea data, refolosind bufferul existent daca are
+ * aceeasi dimensiune. Cu arena, valoarea ramane in blocul intrarii cat timp
+ * incape acolo si este mutata intr-un buffer separat doar cand il depaseste.
+ */
+static void __ht_set_value(hashtable_t *ht, info *entry, void *value,
+	unsigned int value_size)
+{
+	void *old = entry->value, *dest = entry->value;
+
+	if (ht->arena != NULL) {
+		ht_arena_entry_t *e = __HT_ARENA_ENTRY(entry);
+		unsigned char *inline_value = __ht_arena_value(e);
+		unsigned int capacity = e->block_size -
+			(unsigned int)(inline_value - (unsigned char*)e);
+
+		if (value_size <= capacity) {
+			dest = inline_value;
+		} else {
+			dest = malloc(value_size);
+			DIE(dest == NULL, "ht value malloc");
+		}
+		if (old == inline_value)
+			old = dest;
+	} else if (entry->value_size != value_size) {
+		dest = malloc(value_size);
+		DIE(dest == NULL, "ht value malloc");
+	}
+
+	/*
+	 * value poate fi chiar bufferul vechi (ex. ht_put(ht, k, ks, ht_get(ht, k),
+	 * n)), deci se copiaza (cu memmove) inainte ca acesta sa fie eliberat.
+	 */
+	memmove(dest, value, value_size);
+	if (old != dest)
+		free(old);
+	entry->value = dest;
+	entry->value_size = value_size;
+}
+
+/*
+ * Creeaza intrarea (nod + info + copii ale cheii si valorii) dintr-un singur
+ * bloc al arenei.
+ */
+static ll_node_t *__ht_arena_node(hashtable_t *ht, unsigned int hash,
+	void *key, unsigned int key_size, void *value, unsigned int value_size)
+{
+	unsigned int block_size = __HT_ALIGN8(sizeof(ht_arena_entry_t)) +
+		__HT_ALIGN8(key_size) + value_size;
+	block_size = (block_size + 15u) & ~15u;
+
+	ht_arena_entry_t *e = __ht_arena_alloc(ht->arena, block_size);
+	e->block_size = block_size;
+	e->node.data = &e->entry;
+	e->entry.hash = hash;
+	e->entry.key_size = key_size;
+	e->entry.key = __ht_arena_key(e);
+	memcpy(e->entry.key, key, key_size);
+	e->entry.value_size = value_size;
+	e->entry.value = __ht_arena_value(e);
+	memcpy(e->entry.value, value, value_size);
+
+	return &e->node;
+}
+
+/*
+ * Creeaza o intrare noua (cu copii ale cheii si valorii) si o adauga la
+ * inceputul listei date.
+ */
+static info *__ht_insert(hashtable_t *ht, linked_list_t **bucket,
+	unsigned int hash, void *key, unsigned int key_size,
+	void *value, unsigned int value_size)
+{
+	ll_node_t *node;
+
+	if (ht->arena != NULL) {
+		node = __ht_arena_node(ht, hash, key, key_size, value, value_size);
+	} else {
+		info *new = calloc(1, sizeof(info));
+		DIE(new == NULL, "ht info calloc");
+		new->hash = hash;
+		new->key_size = key_size;
+		new->key = malloc(key_size);
+		DIE(new->key == NULL, "ht key malloc");
+		memcpy(new->key, key, key_size);
+		new->value_size = value_size;
+		new->value = malloc(value_size);
+		DIE(new->value == NULL, "ht value malloc");
+		memcpy(new->value, value, value_size);
+
+		node = malloc(sizeof(*node));
+		DIE(node == NULL, "ht node malloc");
+		node->data = new;
+	}
+
+	if (*bucket == NULL)
+		*bucket = ll_create(sizeof(info));
+
+	node->next = (*bucket)->head;
+	(*bucket)->head = node;
+	(*bucket)->size++;
+
+	ht->size++;
+	return (info*)node->data;
+}
+
+/*
+ * Elibereaza memoria unei intrari deja scoase din lista ei.
+ */
+static void __ht_free_node(hashtable_t *ht, ll_node_t *node)
+{
+	if (ht->arena != NULL) {
+		ht_arena_entry_t *e = (ht_arena_entry_t*)node;
+		if (e->entry.value != __ht_arena_value(e))
+			free(e->entry.value);
+		__ht_arena_release(ht->arena, e, e->block_size);
+		return;
+	}
+
+	ht->key_val_free_function(node->data);
+	free(node);
+}
+
+/*
+ * Intoarce intrarea asociata cheii key sau NULL. Spre deosebire de ht_get, nu
+ * modifica tabela (nu face niciun pas de rehash).
+ */
+info *ht_lookup(hashtable_t *ht, void *key)
+{
+	return ht_lookup_hashed(ht, key, __ht_hash(ht, key));
+}
+
+/*
+ * Variantele *_hashed primesc hash-ul cheii deja calculat (trebuie sa fie cel
+ * intors de functia de hash a tabelei), pentru apelantii care il au deja, de
+ * ex. ConcurrentHashtable, care il foloseste si pentru alegerea shard-ului.
+ */
+info *ht_lookup_hashed(hashtable_t *ht, void *key, unsigned int hash)
+{
+	ll_node_t *node = __ht_find(ht, key, hash, NULL, NULL);
+
+	if (node == NULL)
+		return NULL;
+
+	return (info*)node->data;
+}
+
 /*
  * Functie care intoarce:
  * 1, daca pentru cheia key a fost asociata anterior o valoare in hashtable
@@ -265,32 +860,145 @@ hashtable_t *ht_create(unsigned int hmax, unsigned int (*hash_function)(void*),
  */
 int ht_has_key(hashtable_t *ht, void *key)
 {
-	unsigned int index = ht->hash_function(key) % ht->hmax;
-	ll_node_t *iterator = ht->buckets[index]->head;
-	while (iterator != NULL) {
-		if (!ht->compare_function(key, ((info*)iterator->data)->key)) {
-			return 1;
-		}
-		else iterator = iterator->next;
-	}
-
-	return 0;
+	return ht_lookup(ht, key) != NULL;
 }
 
 void *ht_get(hashtable_t *ht, void *key)
 {
-	if(ht_has_key(ht, key)) {
-		unsigned int index = ht->hash_function(key) % ht->hmax;
-		ll_node_t *iterator = ht->buckets[index]->head;
-		while (iterator != NULL) {
-			if (!ht->compare_function(key, ((info*)iterator->data)->key)) {
-				return ((info*)iterator->data)->value;
+	__ht_rehash_step(ht);
+
+	HT_STAT_ADD(ht, gets, 1);
+	info *entry = ht_lookup(ht, key);
+	if (entry == NULL)
+		return NULL;
+
+	HT_STAT_ADD(ht, hits, 1);
+	return entry->value;
+}
+
+/*
+ * Cauta n chei deodata: out_values[i] primeste valoarea asociata cheii keys[i]
+ * (sau NULL), ca la ht_get. Cheile sunt procesate in grupuri de HT_BATCH_SIZE,
+ * in mai multe treceri: intai se calculeaza toate hash-urile, apoi, pe rand,
+ * se aduc in cache (prefetch) slotul din buckets, lista, primul nod si info-ul
+ * lui, pentru fiecare cheie din grup. Astfel, accesele la memorie ale cheilor
+ * diferite se suprapun in loc sa astepte unul dupa altul ca in ht_get.
+ */
+void ht_get_batch(hashtable_t *ht, void **keys, unsigned int n,
+	void **out_values)
+{
+	unsigned int hashes[HT_BATCH_SIZE];
+	linked_list_t **slots[HT_BATCH_SIZE];
+	ll_node_t *heads[HT_BATCH_SIZE];
+
+	__ht_rehash_step(ht);
+	HT_STAT_ADD(ht, gets, n);
+
+	for (unsigned int start = 0; start < n; start += HT_BATCH_SIZE) {
+		unsigned int count = n - start;
+		if (count > HT_BATCH_SIZE)
+			count = HT_BATCH_SIZE;
+
+		for (unsigned int j = 0; j < count; j++) {
+			hashes[j] = __ht_hash(ht, keys[start + j]);
+			slots[j] = __ht_bucket(ht, hashes[j]);
+			__builtin_prefetch(slots[j]);
+		}
+
+		for (unsigned int j = 0; j < count; j++)
+			if (*slots[j] != NULL)
+				__builtin_prefetch(*slots[j]);
+
+		for (unsigned int j = 0; j < count; j++) {
+			heads[j] = *slots[j] ? (*slots[j])->head : NULL;
+			if (heads[j] != NULL)
+				__builtin_prefetch(heads[j]);
+		}
+
+		for (unsigned int j = 0; j < count; j++)
+			if (heads[j] != NULL)
+				__builtin_prefetch(heads[j]->data);
+
+		for (unsigned int j = 0; j < count; j++) {
+			void *key = keys[start + j];
+			ll_node_t *iterator = heads[j];
+
+			out_values[start + j] = NULL;
+			while (iterator != NULL) {
+				info *curr = (info*)iterator->data;
+				HT_STAT_ADD(ht, probes, 1);
+				if (curr->hash == hashes[j] &&
+					!ht->compare_function(key, curr->key)) {
+					out_values[start + j] = curr->value;
+					HT_STAT_ADD(ht, hits, 1);
+					break;
+				}
+				iterator = iterator->next;
 			}
-			else iterator = iterator->next;
 		}
 	}
+}
+
+static info *__ht_get_or_insert(hashtable_t *ht, void *key, unsigned int hash,
+	unsigned int key_size, void *value, unsigned int value_size,
+	int *inserted)
+{
+	linked_list_t **bucket;
+	info *entry;
+
+	__ht_rehash_step(ht);
+
+	HT_STAT_ADD(ht, puts, 1);
+	ll_node_t *node = __ht_find(ht, key, hash, &bucket, NULL);
+	if (node != NULL) {
+		entry = (info*)node->data;
+	} else {
+		HT_STAT_ADD(ht, inserts, 1);
+		entry = __ht_insert(ht, bucket, hash, key, key_size,
+			value, value_size);
+		__ht_check_load(ht);
+	}
+
+	if (inserted)
+		*inserted = (node == NULL);
+	return entry;
+}
+
+/*
+ * Intoarce intrarea asociata cheii key. Daca aceasta nu exista, este inserata
+ * perechea (key, value), ca la ht_put. Daca inserted nu este NULL, in el se
+ * scrie 1 daca s-a creat o intrare noua si 0 altfel. Cheia este hash-uita o
+ * singura data, iar bucket-ul este parcurs o singura data.
+ */
+info *ht_get_or_insert(hashtable_t *ht, void *key, unsigned int key_size,
+	void *value, unsigned int value_size, int *inserted)
+{
+	return __ht_get_or_insert(ht, key, __ht_hash(ht, key), key_size,
+		value, value_size, inserted);
+}
 
-	return NULL;
+static info *__ht_upsert(hashtable_t *ht, void *key, unsigned int hash,
+	unsigned int key_size, void *value, unsigned int value_size)
+{
+	int inserted;
+	info *entry = __ht_get_or_insert(ht, key, hash, key_size,
+		value, value_size, &inserted);
+
+	if (!inserted)
+		__ht_set_value(ht, entry, value, value_size);
+	return entry;
+}
+
+/*
+ * Insereaza perechea (key, value) sau, daca cheia exista deja, ii suprascrie
+ * valoarea. Intoarce intrarea din tabela asociata cheii; pointerul ramane valid
+ * pana la stergerea cheii (un rehash muta doar nodurile listelor).
+ */
+info *ht_upsert(hashtable_t *ht, void *key, unsigned int key_size,
+	void *value, unsigned int value_size)
+{
+	return __ht_upsert(ht, key, __ht_hash(ht, key), key_size,
+		value, value_size);
 }
 
 /*
@@ -313,32 +1021,182 @@ void *ht_get(hashtable_t *ht, void *key)
 void ht_put(hashtable_t *ht, void *key, unsigned int key_size,
 	void *value, unsigned int value_size)
 {
-	if (ht_has_key(ht, key)) {
-		unsigned int index = ht->hash_function(key) % ht->hmax;
-		ll_node_t *iterator = ht->buckets[index]->head;
-		int sw = 1;
-		while (iterator != NULL) {
-			if (!ht->compare_function(key, ((info*)iterator->data)->key)) {
-				sw = 0;
-				memcpy(((info*)iterator->data)->value, value, value_size);
-			}
-			else iterator = iterator->next;
+	ht_upsert(ht, key, key_size, value, value_size);
+}
+
+void ht_put_hashed(hashtable_t *ht, void *key, unsigned int hash,
+	unsigned int key_size, void *value, unsigned int value_size)
+{
+	__ht_upsert(ht, key, hash, key_size, value, value_size);
+}
+
+/*
+ * Pregateste iteratorul it pentru o parcurgere a tuturor intrarilor tabelei.
+ * Atentie! Cat timp iteratorul este folosit, tabela nu trebuie modificata si
+ * nu trebuie apelate ht_get / ht_put / ht_remove_entry (fiecare poate muta
+ * noduri in timpul unui rehash); ht_lookup este permis. Pentru parcurgeri
+ * intrerupte de modificari, folositi ht_scan.
+ */
+void ht_iter_init(hashtable_t *ht, ht_iter_t *it)
+{
+	it->ht = ht;
+	it->old = ht->old_buckets != NULL;
+	it->index = 0;
+	it->node = NULL;
+}
+
+/*
+ * Intoarce urmatoarea intrare a tabelei sau NULL la final. Intrarile sunt
+ * intoarse direct din tabela, fara copieri sau alocari.
+ */
+info *ht_iter_next(ht_iter_t *it)
+{
+	hashtable_t *ht = it->ht;
+
+	if (it->node != NULL)
+		it->node = it->node->next;
+
+	while (it->node == NULL) {
+		linked_list_t **buckets = it->old ? ht->old_buckets : ht->buckets;
+		unsigned int hmax = it->old ? ht->old_hmax : ht->hmax;
+
+		if (it->index >= hmax) {
+			if (!it->old)
+				return NULL;
+			it->old = 0;
+			it->index = 0;
+			continue;
 		}
-		if (sw) {
-			info *new = calloc(1, sizeof(info));
-			new->key = calloc(1, sizeof(key_size));
-			new->value = calloc(1, sizeof(value_size));
-			ll_add_nth_node(ht->buckets[index], ht->buckets[index]->size, new);
+
+		if (buckets[it->index] != NULL)
+			it->node = buckets[it->index]->head;
+		it->index++;
+	}
+
+	return (info*)it->node->data;
+}
+
+/*
+ * Calculeaza cati octeti ocupa, in total, cheile si valorile tabelei, adica
+ * dimensiunile bufferelor necesare pentru ht_export.
+ */
+void ht_export_size(hashtable_t *ht, size_t *keys_bytes, size_t *vals_bytes)
+{
+	ht_iter_t it;
+	info *entry;
+
+	*keys_bytes = 0;
+	*vals_bytes = 0;
+	ht_iter_init(ht, &it);
+	while ((entry = ht_iter_next(&it)) != NULL) {
+		*keys_bytes += entry->key_size;
+		*vals_bytes += entry->value_size;
+	}
+}
+
+/*
+ * Copiaza toate cheile, una dupa alta, in keys_buf si valorile, in aceeasi
+ * ordine, in vals_buf (oricare dintre ele poate fi NULL). Intoarce nr. de
+ * intrari copiate. Bufferele trebuie sa aiba cel putin dimensiunile calculate
+ * de ht_export_size; pentru chei / valori de dimensiune fixa, rezultatul este
+ * chiar un vector de chei / valori.
+ */
+unsigned int ht_export(hashtable_t *ht, void *keys_buf, void *vals_buf)
+{
+	unsigned char *keys_out = keys_buf, *vals_out = vals_buf;
+	unsigned int count = 0;
+	ht_iter_t it;
+	info *entry;
+
+	ht_iter_init(ht, &it);
+	while ((entry = ht_iter_next(&it)) != NULL) {
+		if (keys_out) {
+			memcpy(keys_out, entry->key, entry->key_size);
+			keys_out += entry->key_size;
+		}
+		if (vals_out) {
+			memcpy(vals_out, entry->value, entry->value_size);
+			vals_out += entry->value_size;
 		}
+		count++;
 	}
-	else {
-		info *new = calloc(1, sizeof(info));
-		new->key = calloc(1, sizeof(key_size));
-		new->value = calloc(1, sizeof(value_size));
-		ll_add_nth_node(ht->buckets[index], 1, new);
+
+	return count;
+}
+
+static unsigned int __ht_rev(unsigned int v)
+{
+	v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+	v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+	v = ((v >> 4) & 0x0F0F0F0Fu) | ((v & 0x0F0F0F0Fu) << 4);
+	v = ((v >> 8) & 0x00FF00FFu) | ((v & 0x00FF00FFu) << 8);
+	return (v >> 16) | (v << 16);
+}
+
+static void __ht_scan_bucket(linked_list_t *bucket,
+	void (*fn)(info *entry, void *arg), void *arg)
+{
+	if (bucket == NULL)
+		return;
+
+	ll_node_t *iterator = bucket->head;
+	while (iterator != NULL) {
+		/* fn poate citi intrarea, dar nu are voie sa modifice tabela. */
+		ll_node_t *next = iterator->next;
+		fn((info*)iterator->data, arg);
+		iterator = next;
 	}
 }
 
+/*
+ * Parcurgere reluabila a tabelei (algoritmul SCAN din Redis): un apel viziteaza
+ * cu fn intrarile unui singur bucket (plus bucket-urile corespondente din
+ * cealalta tabela, in timpul unui rehash) si intoarce cursorul pentru apelul
+ * urmator; parcurgerea incepe cu cursorul 0 si se termina cand este intors 0.
+ *
+ * Cursorul este incrementat pe bitii inversati, deci ramane valid si daca
+ * tabela este redimensionata intre apeluri: orice intrare prezenta pe toata
+ * durata parcurgerii este vizitata cel putin o data (unele pot fi vizitate de
+ * doua ori). Intre apeluri, tabela poate fi modificata oricum.
+ */
+unsigned int ht_scan(hashtable_t *ht, unsigned int cursor,
+	void (*fn)(info *entry, void *arg), void *arg)
+{
+	unsigned int v = cursor;
+
+	if (ht->old_buckets == NULL) {
+		unsigned int m0 = ht->hmax - 1;
+		__ht_scan_bucket(ht->buckets[v & m0], fn, arg);
+
+		v |= ~m0;
+		v = __ht_rev(v);
+		v++;
+		return __ht_rev(v);
+	}
+
+	linked_list_t **t0 = ht->old_buckets, **t1 = ht->buckets;
+	unsigned int m0 = ht->old_hmax - 1, m1 = ht->hmax - 1;
+	if (m0 > m1) {
+		linked_list_t **t = t0;
+		t0 = t1;
+		t1 = t;
+		m0 = ht->hmax - 1;
+		m1 = ht->old_hmax - 1;
+	}
+
+	__ht_scan_bucket(t0[v & m0], fn, arg);
+	do {
+		__ht_scan_bucket(t1[v & m1], fn, arg);
+
+		v |= ~m1;
+		v = __ht_rev(v);
+		v++;
+		v = __ht_rev(v);
+	} while (v & (m0 ^ m1));
+
+	return v;
+}
+
 /*
  * Procedura care elimina din hashtable intrarea asociata cheii key.
  * Atentie! Trebuie avuta grija la eliberarea intregii memorii folosite pentru o
@@ -348,16 +1206,59 @@ void ht_put(hashtable_t *ht, void *key, unsigned int key_size,
  */
 void ht_remove_entry(hashtable_t *ht, void *key)
 {
-	unsigned int index = ht->hash_function(key) % ht->hmax;
-	ll_node_t *iterator = ht->buckets[index]->head;
-	while (iterator != NULL) {
-		ll_node_t *temp;
-		if (iterator->next) {
-			temp = iterator->next;
+	ht_remove_entry_hashed(ht, key, __ht_hash(ht, key));
+}
+
+void ht_remove_entry_hashed(hashtable_t *ht, void *key, unsigned int hash)
+{
+	linked_list_t **bucket;
+	ll_node_t *prev;
+
+	__ht_rehash_step(ht);
+
+	ll_node_t *node = __ht_find(ht, key, hash, &bucket, &prev);
+	if (node == NULL)
+		return;
+
+	if (prev == NULL)
+		(*bucket)->head = node->next;
+	else
+		prev->next = node->next;
+	(*bucket)->size--;
+
+	HT_STAT_ADD(ht, removes, 1);
+	__ht_free_node(ht, node);
+	ht->size--;
+	__ht_check_load(ht);
+}
+
+static void __ht_free_buckets(hashtable_t *ht, linked_list_t **buckets,
+	unsigned int hmax)
+{
+	for (unsigned int i = 0; i < hmax; i++) {
+		if (buckets[i] == NULL)
+			continue;
+
+		ll_node_t *iterator = buckets[i]->head;
+		while (iterator != NULL) {
+			ll_node_t *next = iterator->next;
+			if (ht->arena == NULL) {
+				__ht_free_node(ht, iterator);
+			} else {
+				/* Blocurile din chunk-uri dispar odata cu acestea;
+				 * raman doar valorile mutate in afara blocului si
+				 * blocurile prea mari, alocate cu malloc. */
+				ht_arena_entry_t *e = (ht_arena_entry_t*)iterator;
+				if (e->entry.value != __ht_arena_value(e))
+					free(e->entry.value);
+				if (e->block_size / 16 - 1 >= HT_ARENA_CLASSES)
+					free(e);
+			}
+			iterator = next;
 		}
-		key_val_free_function(iterator->data);
-		free(iterator);
+		free(buckets[i]);
 	}
+	free(buckets);
 }
 
 /*
@@ -365,10 +1266,82 @@ void ht_remove_entry(hashtable_t *ht, void *key)
  * dupa care elibereaza si memoria folosita pentru a stoca structura hashtable.
  */
 void ht_free(hashtable_t *ht)
-{	
-    for (int i = 0; i < ht->hmax; i++) {
-    	if ()
-    }
+{
+	if (ht == NULL)
+		return;
+
+	if (ht->old_buckets)
+		__ht_free_buckets(ht, ht->old_buckets, ht->old_hmax);
+	__ht_free_buckets(ht, ht->buckets, ht->hmax);
+	if (ht->arena)
+		__ht_arena_destroy(ht->arena);
+	free(ht);
+}
+
+static void __ht_stats_table(hashtable_t *ht, linked_list_t **buckets,
+	unsigned int hmax, ht_stats_t *out)
+{
+	out->bytes_allocated += (size_t)hmax * sizeof(linked_list_t*);
+
+	for (unsigned int i = 0; i < hmax; i++) {
+		unsigned int len = 0;
+
+		if (buckets[i] != NULL) {
+			out->bytes_allocated += sizeof(linked_list_t);
+			for (ll_node_t *it = buckets[i]->head; it; it = it->next) {
+				info *entry = (info*)it->data;
+				len++;
+				if (ht->arena == NULL)
+					out->bytes_allocated += sizeof(ll_node_t) +
+						sizeof(info) + entry->key_size +
+						entry->value_size;
+			}
+		}
+
+		if (ht->old_buckets == buckets && i < ht->rehash_idx)
+			continue; /* bucket deja mutat */
+		out->chain_hist[len < HT_STATS_HIST ? len : HT_STATS_HIST - 1]++;
+		if (len > out->max_chain)
+			out->max_chain = len;
+	}
+}
+
+/*
+ * Completeaza out cu statisticile tabelei: factorul de incarcare, histograma
+ * lungimilor lanturilor (chain_hist[i] = nr. de bucket-uri cu i intrari;
+ * ultima pozitie aduna lanturile mai lungi), lungimea maxima a unui lant
+ * (nr. maxim de chei comparate de o cautare), starea rehash-ului si memoria
+ * ocupata. Acestea sunt calculate la apel, parcurgand tabela.
+ *
+ * Contoarele operatiilor (gets, hits, puts, inserts, removes, probes,
+ * rehashes) sunt mentinute doar daca HT_STATS este definit la compilare; in
+ * rest sunt 0.
+ */
+void ht_stats(hashtable_t *ht, ht_stats_t *out)
+{
+	memset(out, 0, sizeof(*out));
+
+	out->size = ht->size;
+	out->hmax = ht->hmax;
+	out->load_factor = (double)ht->size / ht->hmax;
+	out->rehashing = ht->old_buckets != NULL;
+
+	out->bytes_allocated = sizeof(hashtable_t);
+	if (ht->old_buckets)
+		__ht_stats_table(ht, ht->old_buckets, ht->old_hmax, out);
+	__ht_stats_table(ht, ht->buckets, ht->hmax, out);
+	if (ht->arena)
+		out->bytes_allocated += sizeof(ht_arena_t) + ht->arena->bytes;
+
+#ifdef HT_STATS
+	out->gets = ht->stats.gets;
+	out->hits = ht->stats.hits;
+	out->puts = ht->stats.puts;
+	out->inserts = ht->stats.inserts;
+	out->removes = ht->stats.removes;
+	out->probes = ht->stats.probes;
+	out->rehashes = ht->stats.rehashes;
+#endif
 }
 
 unsigned int ht_get_size(hashtable_t *ht)
@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
 
 /* useful macro for handling error codes */
@@ -18,6 +19,21 @@
 
 #define MAX_STRING_SIZE	256
 #define HMAX 10
+/* Tabela se dubleaza cand are mai mult de HT_MAX_LOAD intrari per bucket. */
+#define HT_MAX_LOAD 1
+/* Cu auto_shrink, tabela se injumatateste sub o intrare la HT_MIN_LOAD_DIV
+ * bucket-uri. */
+#define HT_MIN_LOAD_DIV 8
+/* Nr. de bucket-uri mutate la fiecare put/get/remove in timpul unui rehash. */
+#define HT_REHASH_STEP 4
+/* Nr. de pozitii ale histogramei lungimilor de lant din ht_stats. */
+#define HT_STATS_HIST 16
+/* Dimensiunea unui chunk al arenei (2 MiB, cat o huge page). */
+#define HT_ARENA_CHUNK (2u << 20)
+/* Nr. de clase de dimensiune ale arenei (multipli de 16 octeti). */
+#define HT_ARENA_CLASSES 32
+/* Nr. de chei ale caror accese la memorie sunt suprapuse de ht_get_batch. */
+#define HT_BATCH_SIZE 16
 
 typedef struct ll_node_t {
     void* data;
@@ -34,6 +50,68 @@ typedef struct info info;
 struct info {
 	void *key;
 	void *value;
+	/* Hash-ul cheii, memorat pentru a nu fi recalculat. */
+	unsigned int hash;
+	/* Dimensiunile copiilor lui key si value. */
+	unsigned int key_size;
+	unsigned int value_size;
+};
+
+/*
+ * Alocator arena pentru intrarile unei tabele: nod, info, cheie si valoare
+ * sunt plasate intr-un singur bloc taiat dintr-un chunk mare.
+ */
+typedef struct ht_arena_t ht_arena_t;
+struct ht_arena_t {
+	/* Lista chunk-urilor (primul cuvant din fiecare chunk il indica pe urmatorul). */
+	void *chunks;
+	/* Zona inca neimpartita din chunk-ul curent. */
+	unsigned char *cursor;
+	size_t left;
+	/* Blocuri eliberate, cate o lista pentru fiecare multiplu de 16 octeti. */
+	void *free_lists[HT_ARENA_CLASSES];
+	/* Nr. de octeti obtinuti de la sistem. */
+	size_t bytes;
+};
+
+/*
+ * Contoarele operatiilor unei tabele; exista doar daca HT_STATS este definit
+ * (la fel in toate fisierele compilate, deoarece schimba structura tabelei).
+ */
+typedef struct ht_counters_t ht_counters_t;
+struct ht_counters_t {
+	unsigned long long gets;
+	unsigned long long hits;
+	unsigned long long puts;
+	unsigned long long inserts;
+	unsigned long long removes;
+	/* Nr. de noduri vizitate de cautari. */
+	unsigned long long probes;
+	/* Nr. de redimensionari pornite. */
+	unsigned long long rehashes;
+};
+
+/* Rezultatul lui ht_stats. */
+typedef struct ht_stats_t ht_stats_t;
+struct ht_stats_t {
+	unsigned int size;
+	unsigned int hmax;
+	double load_factor;
+	/* chain_hist[i] = nr. de bucket-uri cu i intrari (ultima: >= i). */
+	unsigned int chain_hist[HT_STATS_HIST];
+	unsigned int max_chain;
+	/* 1 daca un rehash incremental este in desfasurare. */
+	int rehashing;
+	/* Memoria ocupata de tabela si de intrarile ei. */
+	size_t bytes_allocated;
+	/* Contoare (0 daca HT_STATS nu este definit). */
+	unsigned long long gets;
+	unsigned long long hits;
+	unsigned long long puts;
+	unsigned long long inserts;
+	unsigned long long removes;
+	unsigned long long probes;
+	unsigned long long rehashes;
 };
 
 typedef struct hashtable_t hashtable_t;
@@ -41,15 +119,53 @@ struct hashtable_t {
 	linked_list_t **buckets; /* Array de liste simplu-inlantuite. */
 	/* Nr. total de noduri existente curent in toate bucket-urile. */
 	unsigned int size;
-	unsigned int hmax; /* Nr. de bucket-uri. */
+	unsigned int hmax; /* Nr. de bucket-uri (putere a lui 2). */
+	/* Tabela veche, golita incremental in timpul unui rehash (altfel NULL). */
+	linked_list_t **old_buckets;
+	unsigned int old_hmax;
+	/* Bucket-urile din old_buckets cu index < rehash_idx au fost mutate. */
+	unsigned int rehash_idx;
+	/* hmax-ul initial, sub care tabela nu se micsoreaza. */
+	unsigned int min_hmax;
+	/* 1 daca tabela se micsoreaza automat dupa stergeri. */
+	int auto_shrink;
+	/* Alocatorul intrarilor, sau NULL daca se foloseste malloc. */
+	ht_arena_t *arena;
+#ifdef HT_STATS
+	ht_counters_t stats;
+#endif
 	/* (Pointer la) Functie pentru a calcula valoarea hash asociata cheilor. */
 	unsigned int (*hash_function)(void*);
+	/*
+	 * (Pointer la) Functie de hash cu seed pentru chei de lungime data; daca
+	 * este setata, se foloseste in locul lui hash_function.
+	 */
+	unsigned long long (*hash_bytes_function)(const void*, size_t,
+		unsigned long long);
+	/* Seed-ul tabelei, transmis lui hash_bytes_function. */
+	unsigned long long seed;
+	/* Dimensiunea fixa a cheilor, sau 0 pentru siruri terminate cu '\0'. */
+	unsigned int key_size;
 	/* (Pointer la) Functie pentru a compara doua chei. */
 	int (*compare_function)(void*, void*);
 	/* (Pointer la) Functie pentru a elibera memoria ocupata de cheie si valoare. */
 	void (*key_val_free_function)(void*);
 };
 
+/*
+ * Iterator peste toate intrarile unei tabele (vezi ht_iter_init): parcurge
+ * intai old_buckets (daca un rehash este in desfasurare), apoi buckets.
+ */
+typedef struct ht_iter_t ht_iter_t;
+struct ht_iter_t {
+	hashtable_t *ht;
+	/* 1 cat timp se parcurge old_buckets. */
+	int old;
+	/* Urmatorul bucket de vizitat si nodul curent. */
+	unsigned int index;
+	ll_node_t *node;
+};
+
 linked_list_t *ll_create(unsigned int data_size);
 void ll_add_nth_node(linked_list_t* list, unsigned int n, const void* new_data);
 ll_node_t *ll_remove_nth_node(linked_list_t* list, unsigned int n);
@@ -61,16 +177,44 @@ int compare_function_ints(void *a, void *b);
 int compare_function_strings(void *a, void *b);
 unsigned int hash_function_int(void *a);
 unsigned int hash_function_string(void *a);
+unsigned long long hash_bytes(const void *data, size_t len,
+	unsigned long long seed);
+unsigned long long hash_random_seed(void);
 void key_val_free_function(void *data);
 hashtable_t *ht_create(unsigned int hmax, unsigned int (*hash_function)(void*),
 		int (*compare_function)(void*, void*),
 		void (*key_val_free_function)(void*));
+hashtable_t *ht_create_seeded(unsigned int hmax, unsigned int key_size,
+		unsigned long long (*hash_bytes_function)(const void*, size_t,
+			unsigned long long),
+		int (*compare_function)(void*, void*),
+		void (*key_val_free_function)(void*));
+void ht_enable_arena(hashtable_t *ht);
+void ht_set_auto_shrink(hashtable_t *ht, int enable);
+info *ht_lookup(hashtable_t *ht, void *key);
+info *ht_lookup_hashed(hashtable_t *ht, void *key, unsigned int hash);
 int ht_has_key(hashtable_t *ht, void *key);
 void *ht_get(hashtable_t *ht, void *key);
+void ht_get_batch(hashtable_t *ht, void **keys, unsigned int n,
+	void **out_values);
 void ht_put(hashtable_t *ht, void *key, unsigned int key_size,
 	void *value, unsigned int value_size);
+void ht_put_hashed(hashtable_t *ht, void *key, unsigned int hash,
+	unsigned int key_size, void *value, unsigned int value_size);
+info *ht_get_or_insert(hashtable_t *ht, void *key, unsigned int key_size,
+	void *value, unsigned int value_size, int *inserted);
+info *ht_upsert(hashtable_t *ht, void *key, unsigned int key_size,
+	void *value, unsigned int value_size);
+void ht_iter_init(hashtable_t *ht, ht_iter_t *it);
+info *ht_iter_next(ht_iter_t *it);
+void ht_export_size(hashtable_t *ht, size_t *keys_bytes, size_t *vals_bytes);
+unsigned int ht_export(hashtable_t *ht, void *keys_buf, void *vals_buf);
+unsigned int ht_scan(hashtable_t *ht, unsigned int cursor,
+	void (*fn)(info *entry, void *arg), void *arg);
 void ht_remove_entry(hashtable_t *ht, void *key);
+void ht_remove_entry_hashed(hashtable_t *ht, void *key, unsigned int hash);
 void ht_free(hashtable_t *ht);
+void ht_stats(hashtable_t *ht, ht_stats_t *out);
 unsigned int ht_get_size(hashtable_t *ht);
 unsigned int ht_get_hmax(hashtable_t *ht);
 
@@ -0,0 +1,174 @@
+#include "HashtableCache.h"
+
+/*
+ * Cache LRU construit peste hashtable_t: tabela gaseste nodul unei chei in
+ * O(1), iar lista dublu inlantuita a nodurilor tine ordinea folosirii, deci
+ * get, put si evacuarea celei mai vechi intrari sunt toate O(1). Cache-ul
+ * evacueaza intrari cat timp suma key_size + value_size depaseste max_bytes.
+ */
+
+static void __cache_unlink(ht_cache_t *cache, cache_node_t *node)
+{
+	if (node->prev)
+		node->prev->next = node->next;
+	else
+		cache->head = node->next;
+
+	if (node->next)
+		node->next->prev = node->prev;
+	else
+		cache->tail = node->prev;
+
+	node->prev = node->next = NULL;
+}
+
+static void __cache_push_front(ht_cache_t *cache, cache_node_t *node)
+{
+	node->prev = NULL;
+	node->next = cache->head;
+	if (cache->head)
+		cache->head->prev = node;
+	cache->head = node;
+	if (cache->tail == NULL)
+		cache->tail = node;
+}
+
+/*
+ * Scoate nodul din lista si din tabela si ii elibereaza memoria.
+ */
+static void __cache_drop(ht_cache_t *cache, cache_node_t *node)
+{
+	__cache_unlink(cache, node);
+	cache->bytes -= (size_t)node->key_size + node->value_size;
+
+	/* node->key este copia din tabela; ht_remove_entry o elibereaza abia
+	 * dupa ce a gasit intrarea. */
+	ht_remove_entry(cache->map, node->key);
+	free(node->value);
+	free(node);
+}
+
+/*
+ * Functie apelata pentru a aloca un cache de cel mult max_bytes octeti
+ * (suma dimensiunilor cheilor si valorilor).
+ */
+ht_cache_t *ht_cache_create(size_t max_bytes,
+		unsigned int (*hash_function)(void*),
+		int (*compare_function)(void*, void*))
+{
+	ht_cache_t *cache = calloc(1, sizeof(ht_cache_t));
+	DIE(cache == NULL, "ht_cache calloc");
+
+	cache->map = ht_create(HMAX, hash_function, compare_function,
+		key_val_free_function);
+	cache->max_bytes = max_bytes;
+
+	return cache;
+}
+
+/*
+ * Intoarce valoarea asociata cheii key (sau NULL) si marcheaza intrarea ca
+ * fiind cea mai recent folosita. Pointerul ramane valid pana cand intrarea
+ * este suprascrisa, stearsa sau evacuata.
+ */
+void *ht_cache_get(ht_cache_t *cache, void *key)
+{
+	cache_node_t **slot = ht_get(cache->map, key);
+
+	if (slot == NULL) {
+		cache->misses++;
+		return NULL;
+	}
+
+	cache_node_t *node = *slot;
+	cache->hits++;
+	if (cache->head != node) {
+		__cache_unlink(cache, node);
+		__cache_push_front(cache, node);
+	}
+
+	return node->value;
+}
+
+/*
+ * Insereaza sau actualizeaza perechea (key, value), o marcheaza ca fiind cea
+ * mai recent folosita, apoi evacueaza intrarile cele mai vechi pana cand
+ * cache-ul incape in max_bytes. O intrare mai mare decat intregul cache este
+ * evacuata imediat.
+ */
+void ht_cache_put(ht_cache_t *cache, void *key, unsigned int key_size,
+	void *value, unsigned int value_size)
+{
+	cache_node_t *node = NULL;
+	int inserted;
+
+	info *entry = ht_get_or_insert(cache->map, key, key_size, &node,
+		sizeof(node), &inserted);
+
+	if (inserted) {
+		node = calloc(1, sizeof(cache_node_t));
+		DIE(node == NULL, "ht_cache node calloc");
+		node->key = entry->key;
+		node->key_size = key_size;
+		*(cache_node_t**)entry->value = node;
+	} else {
+		node = *(cache_node_t**)entry->value;
+		__cache_unlink(cache, node);
+		cache->bytes -= (size_t)node->key_size + node->value_size;
+	}
+
+	if (node->value == NULL || node->value_size != value_size) {
+		free(node->value);
+		node->value = malloc(value_size);
+		DIE(node->value == NULL, "ht_cache value malloc");
+	}
+	memcpy(node->value, value, value_size);
+	node->value_size = value_size;
+
+	__cache_push_front(cache, node);
+	cache->bytes += (size_t)key_size + value_size;
+
+	while (cache->bytes > cache->max_bytes && cache->tail != NULL) {
+		__cache_drop(cache, cache->tail);
+		cache->evictions++;
+	}
+}
+
+/*
+ * Procedura care elimina din cache intrarea asociata cheii key.
+ */
+void ht_cache_remove(ht_cache_t *cache, void *key)
+{
+	info *entry = ht_lookup(cache->map, key);
+
+	if (entry != NULL)
+		__cache_drop(cache, *(cache_node_t**)entry->value);
+}
+
+/*
+ * Procedura care elibereaza toate intrarile cache-ului si cache-ul insusi.
+ */
+void ht_cache_free(ht_cache_t *cache)
+{
+	if (cache == NULL)
+		return;
+
+	cache_node_t *node = cache->head;
+	while (node != NULL) {
+		cache_node_t *next = node->next;
+		free(node->value);
+		free(node);
+		node = next;
+	}
+
+	ht_free(cache->map);
+	free(cache);
+}
+
+unsigned int ht_cache_get_size(ht_cache_t *cache)
+{
+	if (cache == NULL)
+		return 0;
+
+	return ht_get_size(cache->map);
+}
@@ -0,0 +1,46 @@
+#ifndef __HASHTABLE_CACHE_H_
+#define __HASHTABLE_CACHE_H_
+
+#include "Hashtable.h"
+
+/*
+ * Nod al listei de recenta, dupa modelul dll_node_t (listaDubluInlantuita),
+ * dar intruziv: nodul este chiar intrarea din cache.
+ */
+typedef struct cache_node_t cache_node_t;
+struct cache_node_t {
+	/* Cheia, adica chiar copia pastrata de hashtable (nu o copie separata). */
+	void *key;
+	/* Copia valorii. */
+	void *value;
+	unsigned int key_size;
+	unsigned int value_size;
+	cache_node_t *prev, *next;
+};
+
+typedef struct ht_cache_t ht_cache_t;
+struct ht_cache_t {
+	/* Cheie -> (cache_node_t*) nodul ei din lista de recenta. */
+	hashtable_t *map;
+	/* head = intrarea folosita cel mai recent, tail = cea mai veche. */
+	cache_node_t *head, *tail;
+	/* Nr. maxim de octeti (chei + valori) si nr. curent de octeti. */
+	size_t max_bytes;
+	size_t bytes;
+	/* Contoare: get-uri reusite, get-uri ratate, intrari evacuate. */
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long evictions;
+};
+
+ht_cache_t *ht_cache_create(size_t max_bytes,
+		unsigned int (*hash_function)(void*),
+		int (*compare_function)(void*, void*));
+void *ht_cache_get(ht_cache_t *cache, void *key);
+void ht_cache_put(ht_cache_t *cache, void *key, unsigned int key_size,
+	void *value, unsigned int value_size);
+void ht_cache_remove(ht_cache_t *cache, void *key);
+void ht_cache_free(ht_cache_t *cache);
+unsigned int ht_cache_get_size(ht_cache_t *cache);
+
+#endif
@@ -0,0 +1,317 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "HashtableSnapshot.h"
+
+/*
+ * Imagine persistenta a unui hashtable_t, ce poate fi redeschisa prin mmap
+ * fara nicio deserializare. Fisierul contine antetul, vectorul de offset-uri
+ * ale bucket-urilor si intrarile; intrarile aceluiasi bucket sunt scrise una
+ * dupa alta, deci o cautare parcurge de regula o singura zona contigua.
+ */
+
+#define __SNAP_ALIGN8(x) (((unsigned long long)(x) + 7ull) & ~7ull)
+
+static inline unsigned long long __snap_entry_size(info *entry)
+{
+	return sizeof(ht_snapshot_entry_t) + __SNAP_ALIGN8(entry->key_size) +
+		__SNAP_ALIGN8(entry->value_size);
+}
+
+/*
+ * Apeleaza visit pentru fiecare intrare a tabelei, inclusiv pentru cele inca
+ * nemutate dintr-un rehash in desfasurare.
+ */
+static void __snap_for_each(hashtable_t *ht,
+	void (*visit)(info *entry, void *arg), void *arg)
+{
+	linked_list_t **tables[2] = {ht->old_buckets, ht->buckets};
+	unsigned int sizes[2] = {ht->old_hmax, ht->hmax};
+
+	for (int t = 0; t < 2; t++) {
+		if (tables[t] == NULL)
+			continue;
+		for (unsigned int i = 0; i < sizes[t]; i++) {
+			if (tables[t][i] == NULL)
+				continue;
+			for (ll_node_t *it = tables[t][i]->head; it; it = it->next)
+				visit((info*)it->data, arg);
+		}
+	}
+}
+
+typedef struct __snap_writer_t __snap_writer_t;
+struct __snap_writer_t {
+	unsigned char *base;
+	unsigned long long *buckets;
+	/* Pozitia urmatoarei intrari si ultima intrare scrisa, per bucket. */
+	unsigned long long *cursor;
+	unsigned long long *last;
+	unsigned int mask;
+};
+
+static void __snap_count(info *entry, void *arg)
+{
+	__snap_writer_t *w = arg;
+
+	w->cursor[entry->hash & w->mask] += __snap_entry_size(entry);
+}
+
+static void __snap_write(info *entry, void *arg)
+{
+	__snap_writer_t *w = arg;
+	unsigned int b = entry->hash & w->mask;
+	unsigned long long off = w->cursor[b];
+	ht_snapshot_entry_t *out = (ht_snapshot_entry_t*)(w->base + off);
+
+	out->next = 0;
+	out->hash = entry->hash;
+	out->key_size = entry->key_size;
+	out->value_size = entry->value_size;
+	out->pad = 0;
+	memcpy(out + 1, entry->key, entry->key_size);
+	memcpy((unsigned char*)(out + 1) + __SNAP_ALIGN8(entry->key_size),
+		entry->value, entry->value_size);
+
+	if (w->last[b])
+		((ht_snapshot_entry_t*)(w->base + w->last[b]))->next = off;
+	else
+		w->buckets[b] = off;
+	w->last[b] = off;
+	w->cursor[b] += __snap_entry_size(entry);
+}
+
+/*
+ * Scrie in fisierul path o imagine a tabelei. Fisierul este construit intr-un
+ * fisier temporar (path + ".tmp") si apoi redenumit, deci o imagine veche nu
+ * este niciodata lasata pe jumatate scrisa. Intoarce 0 la succes si -1 (cu
+ * errno setat) la eroare.
+ *
+ * Atentie! Se salveaza doar octetii cheilor si valorilor; valorile ce contin
+ * pointeri nu vor fi valide la redeschidere. Tabelele cu seed trebuie sa
+ * foloseasca hash_bytes, singura functie ce poate fi refacuta la deschidere.
+ */
+int ht_save(hashtable_t *ht, const char *path)
+{
+	if (ht->hash_bytes_function && ht->hash_bytes_function != hash_bytes) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	unsigned int hmax = 1;
+	while (hmax < ht->size)
+		hmax <<= 1;
+
+	__snap_writer_t w;
+	w.mask = hmax - 1;
+	w.cursor = calloc(hmax, sizeof(unsigned long long));
+	DIE(w.cursor == NULL, "ht_save cursor calloc");
+	w.last = calloc(hmax, sizeof(unsigned long long));
+	DIE(w.last == NULL, "ht_save last calloc");
+
+	/* Dimensiunea fiecarui bucket, apoi inceputul lui in fisier. */
+	__snap_for_each(ht, __snap_count, &w);
+	unsigned long long off = __SNAP_ALIGN8(sizeof(ht_snapshot_header_t)) +
+		(unsigned long long)hmax * sizeof(unsigned long long);
+	for (unsigned int b = 0; b < hmax; b++) {
+		unsigned long long bytes = w.cursor[b];
+		w.cursor[b] = off;
+		off += bytes;
+	}
+	unsigned long long file_size = off;
+
+	size_t tmp_len = strlen(path) + 5;
+	char *tmp = malloc(tmp_len);
+	DIE(tmp == NULL, "ht_save path malloc");
+	snprintf(tmp, tmp_len, "%s.tmp", path);
+
+	int rc = -1;
+	int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		goto out;
+	if (ftruncate(fd, file_size) < 0)
+		goto out_close;
+
+	w.base = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (w.base == MAP_FAILED)
+		goto out_close;
+
+	ht_snapshot_header_t *header = (ht_snapshot_header_t*)w.base;
+	memcpy(header->magic, HT_SNAPSHOT_MAGIC, sizeof(header->magic));
+	header->hmax = hmax;
+	header->size = ht->size;
+	header->flags = ht->hash_bytes_function ? HT_SNAPSHOT_SEEDED : 0;
+	header->key_size = ht->key_size;
+	header->seed = ht->seed;
+	header->buckets = __SNAP_ALIGN8(sizeof(ht_snapshot_header_t));
+	header->file_size = file_size;
+	w.buckets = (unsigned long long*)(w.base + header->buckets);
+
+	__snap_for_each(ht, __snap_write, &w);
+
+	if (msync(w.base, file_size, MS_SYNC) == 0)
+		rc = 0;
+	munmap(w.base, file_size);
+
+out_close:
+	if (close(fd) < 0)
+		rc = -1;
+	if (rc == 0 && rename(tmp, path) < 0)
+		rc = -1;
+	if (rc < 0)
+		unlink(tmp);
+out:
+	free(tmp);
+	free(w.cursor);
+	free(w.last);
+	return rc;
+}
+
+/*
+ * Deschide (read-only) o imagine scrisa cu ht_save. Functiile nu pot fi
+ * salvate in fisier, deci hash_function si compare_function trebuie sa fie
+ * aceleasi ca ale tabelei originale (hash_function poate fi NULL pentru
+ * tabelele cu seed). Intoarce NULL (cu errno setat) la eroare.
+ */
+ht_snapshot_t *ht_open_mmap(const char *path,
+		unsigned int (*hash_function)(void*),
+		int (*compare_function)(void*, void*))
+{
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return NULL;
+	}
+	if ((size_t)st.st_size < sizeof(ht_snapshot_header_t)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	unsigned char *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+		fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return NULL;
+
+	ht_snapshot_header_t *header = (ht_snapshot_header_t*)base;
+	if (memcmp(header->magic, HT_SNAPSHOT_MAGIC, sizeof(header->magic)) ||
+		header->file_size != (unsigned long long)st.st_size ||
+		header->hmax == 0 || (header->hmax & (header->hmax - 1)) ||
+		header->buckets < sizeof(ht_snapshot_header_t) ||
+		header->buckets % 8 || header->buckets > header->file_size ||
+		(header->file_size - header->buckets) / sizeof(unsigned long long) <
+		header->hmax ||
+		(!(header->flags & HT_SNAPSHOT_SEEDED) && hash_function == NULL)) {
+		munmap(base, st.st_size);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	ht_snapshot_t *snap = calloc(1, sizeof(ht_snapshot_t));
+	DIE(snap == NULL, "ht_snapshot calloc");
+	snap->base = base;
+	snap->length = st.st_size;
+	snap->header = header;
+	snap->buckets = (unsigned long long*)(base + header->buckets);
+	snap->hash_function = hash_function;
+	snap->compare_function = compare_function;
+
+	return snap;
+}
+
+static unsigned int __snap_hash(ht_snapshot_t *snap, void *key)
+{
+	if (!(snap->header->flags & HT_SNAPSHOT_SEEDED))
+		return snap->hash_function(key);
+
+	size_t len = snap->header->key_size ? snap->header->key_size
+		: strlen((char*)key);
+	return (unsigned int)hash_bytes(key, len, snap->header->seed);
+}
+
+/*
+ * Intoarce intrarea de la offset-ul off, sau NULL daca aceasta nu este
+ * aliniata ori nu incape in intregime (antet, cheie si valoare) in imagine,
+ * ca un fisier trunchiat sau corupt sa nu duca la citiri in afara maparii.
+ */
+static ht_snapshot_entry_t *__snap_entry_at(ht_snapshot_t *snap,
+	unsigned long long off)
+{
+	if (off % 8 || off > snap->length ||
+		snap->length - off < sizeof(ht_snapshot_entry_t))
+		return NULL;
+
+	ht_snapshot_entry_t *entry = (ht_snapshot_entry_t*)(snap->base + off);
+	if (__SNAP_ALIGN8(entry->key_size) + entry->value_size >
+		snap->length - off - sizeof(ht_snapshot_entry_t))
+		return NULL;
+
+	return entry;
+}
+
+/*
+ * Un lant nu poate avea mai mult de size intrari; limita opreste si ciclurile
+ * dintr-un fisier corupt.
+ */
+static ht_snapshot_entry_t *__snap_find(ht_snapshot_t *snap, void *key)
+{
+	unsigned int hash = __snap_hash(snap, key);
+	unsigned long long off = snap->buckets[hash & (snap->header->hmax - 1)];
+
+	for (unsigned int steps = 0; off != 0 && steps < snap->header->size;
+		steps++) {
+		ht_snapshot_entry_t *entry = __snap_entry_at(snap, off);
+		if (entry == NULL)
+			return NULL;
+		if (entry->hash == hash &&
+			!snap->compare_function(key, entry + 1))
+			return entry;
+		off = entry->next;
+	}
+
+	return NULL;
+}
+
+int ht_snapshot_has_key(ht_snapshot_t *snap, void *key)
+{
+	return __snap_find(snap, key) != NULL;
+}
+
+/*
+ * Intoarce valoarea asociata cheii key direct din imaginea mapata (read-only,
+ * aliniata la 8 octeti), sau NULL. Pointerul ramane valid pana la
+ * ht_snapshot_close.
+ */
+void *ht_snapshot_get(ht_snapshot_t *snap, void *key)
+{
+	ht_snapshot_entry_t *entry = __snap_find(snap, key);
+
+	if (entry == NULL)
+		return NULL;
+
+	return (unsigned char*)(entry + 1) + __SNAP_ALIGN8(entry->key_size);
+}
+
+unsigned int ht_snapshot_get_size(ht_snapshot_t *snap)
+{
+	if (snap == NULL)
+		return 0;
+
+	return snap->header->size;
+}
+
+void ht_snapshot_close(ht_snapshot_t *snap)
+{
+	if (snap == NULL)
+		return;
+
+	munmap(snap->base, snap->length);
+	free(snap);
+}
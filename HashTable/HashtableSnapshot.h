@@ -0,0 +1,68 @@
+#ifndef __HASHTABLE_SNAPSHOT_H_
+#define __HASHTABLE_SNAPSHOT_H_
+
+#include "Hashtable.h"
+
+#define HT_SNAPSHOT_MAGIC "HTSNAP01"
+
+/* Tabela a fost creata cu ht_create_seeded (si hash_bytes). */
+#define HT_SNAPSHOT_SEEDED 1
+
+/*
+ * Antetul fisierului. Toate referintele din fisier sunt offset-uri fata de
+ * inceputul lui, deci imaginea poate fi mapata la orice adresa.
+ */
+typedef struct ht_snapshot_header_t ht_snapshot_header_t;
+struct ht_snapshot_header_t {
+	char magic[8];
+	/* Nr. de bucket-uri (putere a lui 2) si nr. de intrari. */
+	unsigned int hmax;
+	unsigned int size;
+	/* HT_SNAPSHOT_SEEDED sau 0. */
+	unsigned int flags;
+	/* key_size-ul tabelei (0 = siruri), folosit de hash-ul cu seed. */
+	unsigned int key_size;
+	unsigned long long seed;
+	/* Offset-ul vectorului de hmax offset-uri de bucket. */
+	unsigned long long buckets;
+	/* Dimensiunea totala a fisierului. */
+	unsigned long long file_size;
+};
+
+/*
+ * O intrare din fisier; cheia urmeaza imediat dupa structura, iar valoarea
+ * dupa cheie, la un offset aliniat la 8 octeti.
+ */
+typedef struct ht_snapshot_entry_t ht_snapshot_entry_t;
+struct ht_snapshot_entry_t {
+	/* Offset-ul urmatoarei intrari din acelasi bucket, sau 0. */
+	unsigned long long next;
+	unsigned int hash;
+	unsigned int key_size;
+	unsigned int value_size;
+	unsigned int pad;
+};
+
+typedef struct ht_snapshot_t ht_snapshot_t;
+struct ht_snapshot_t {
+	/* Imaginea mapata (read-only) si dimensiunea ei. */
+	unsigned char *base;
+	size_t length;
+	ht_snapshot_header_t *header;
+	unsigned long long *buckets;
+	/* (Pointer la) Functie pentru a calcula valoarea hash asociata cheilor. */
+	unsigned int (*hash_function)(void*);
+	/* (Pointer la) Functie pentru a compara doua chei. */
+	int (*compare_function)(void*, void*);
+};
+
+int ht_save(hashtable_t *ht, const char *path);
+ht_snapshot_t *ht_open_mmap(const char *path,
+		unsigned int (*hash_function)(void*),
+		int (*compare_function)(void*, void*));
+int ht_snapshot_has_key(ht_snapshot_t *snap, void *key);
+void *ht_snapshot_get(ht_snapshot_t *snap, void *key);
+unsigned int ht_snapshot_get_size(ht_snapshot_t *snap);
+void ht_snapshot_close(ht_snapshot_t *snap);
+
+#endif
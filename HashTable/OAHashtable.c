@@ -0,0 +1,315 @@
+#include <string.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "OAHashtable.h"
+
+/*
+ * Hashtable cu adresare deschisa, in stilul "Swiss table". Spre deosebire de
+ * hashtable_t, cheile si valorile sunt copiate direct in doi vectori contigui,
+ * iar fiecare slot are un octet de control cu 7 biti din hash. O cautare
+ * verifica un grup intreg de octeti de control deodata si compara doar cheile
+ * din sloturile al caror octet coincide, fara alocari si fara pointeri.
+ *
+ * Hash-ul se imparte in doua: bitii 0-6 (h2) ajung in octetul de control, iar
+ * restul (h1) aleg grupul de start. Grupurile sunt aliniate la OA_GROUP_WIDTH
+ * si sunt vizitate liniar; cautarea se opreste la primul grup ce contine un
+ * slot OA_EMPTY.
+ */
+
+#define __OA_H1(hash) ((hash) >> 7)
+#define __OA_H2(hash) ((unsigned char)((hash) & 0x7F))
+
+static inline unsigned char *__oa_key(oa_hashtable_t *ht, unsigned int i)
+{
+	return ht->keys + (size_t)i * ht->key_size;
+}
+
+static inline unsigned char *__oa_value(oa_hashtable_t *ht, unsigned int i)
+{
+	return ht->values + (size_t)i * ht->value_size;
+}
+
+/*
+ * Intoarce o masca de biti cu bitul j setat daca octetul de control j din grup
+ * este egal cu byte.
+ */
+static inline unsigned int __oa_match(const unsigned char *group,
+	unsigned char byte)
+{
+#if defined(__AVX2__)
+	__m256i ctrl = _mm256_loadu_si256((const __m256i *)group);
+	return (unsigned int)_mm256_movemask_epi8(
+		_mm256_cmpeq_epi8(ctrl, _mm256_set1_epi8((char)byte)));
+#elif defined(__SSE2__)
+	__m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+	return (unsigned int)_mm_movemask_epi8(
+		_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)byte)));
+#else
+	unsigned int mask = 0;
+	for (unsigned int j = 0; j < OA_GROUP_WIDTH; j++)
+		if (group[j] == byte)
+			mask |= 1u << j;
+	return mask;
+#endif
+}
+
+/*
+ * Intoarce masca sloturilor libere (OA_EMPTY sau OA_DELETED) din grup, adica a
+ * octetilor de control cu bitul 7 setat.
+ */
+static inline unsigned int __oa_match_free(const unsigned char *group)
+{
+#if defined(__AVX2__)
+	return (unsigned int)_mm256_movemask_epi8(
+		_mm256_loadu_si256((const __m256i *)group));
+#elif defined(__SSE2__)
+	return (unsigned int)_mm_movemask_epi8(
+		_mm_loadu_si128((const __m128i *)group));
+#else
+	unsigned int mask = 0;
+	for (unsigned int j = 0; j < OA_GROUP_WIDTH; j++)
+		if (group[j] & 0x80)
+			mask |= 1u << j;
+	return mask;
+#endif
+}
+
+static void __oa_alloc_slots(oa_hashtable_t *ht, unsigned int hmax)
+{
+	ht->ctrl = malloc(hmax);
+	DIE(ht->ctrl == NULL, "oa_ht ctrl malloc");
+	memset(ht->ctrl, OA_EMPTY, hmax);
+	ht->keys = calloc(hmax, ht->key_size);
+	DIE(ht->keys == NULL, "oa_ht keys calloc");
+	ht->values = calloc(hmax, ht->value_size);
+	DIE(ht->values == NULL, "oa_ht values calloc");
+	ht->hmax = hmax;
+	ht->size = 0;
+	ht->tombstones = 0;
+}
+
+/*
+ * Functie apelata pentru a aloca si initializa un hashtable cu adresare
+ * deschisa. hmax este rotunjit la o putere a lui 2 (minim OA_HMIN). key_size si
+ * value_size sunt dimensiunile maxime ale unei chei, respectiv ale unei valori:
+ * fiecare slot rezerva exact atatia octeti.
+ */
+oa_hashtable_t *oa_ht_create(unsigned int hmax, unsigned int key_size,
+		unsigned int value_size, unsigned int (*hash_function)(void*),
+		int (*compare_function)(void*, void*))
+{
+	oa_hashtable_t *ht = calloc(1, sizeof(oa_hashtable_t));
+	DIE(ht == NULL, "oa_ht calloc");
+
+	unsigned int cap = OA_HMIN;
+	while (cap < hmax)
+		cap <<= 1;
+
+	ht->key_size = key_size;
+	ht->value_size = value_size;
+	ht->hash_function = hash_function;
+	ht->compare_function = compare_function;
+	__oa_alloc_slots(ht, cap);
+
+	return ht;
+}
+
+/*
+ * Intoarce indexul slotului ce contine cheia key (cu hash-ul dat) sau -1 daca
+ * aceasta nu se afla in tabela.
+ */
+static long __oa_find(oa_hashtable_t *ht, void *key, unsigned int hash)
+{
+	unsigned int gmask = ht->hmax / OA_GROUP_WIDTH - 1;
+	unsigned int g = __OA_H1(hash) & gmask;
+	unsigned char h2 = __OA_H2(hash);
+
+	while (1) {
+		unsigned int base = g * OA_GROUP_WIDTH;
+		unsigned char *group = ht->ctrl + base;
+		unsigned int mask = __oa_match(group, h2);
+
+		while (mask) {
+			unsigned int i = base + __builtin_ctz(mask);
+			if (!ht->compare_function(key, __oa_key(ht, i)))
+				return i;
+			mask &= mask - 1;
+		}
+
+		if (__oa_match(group, OA_EMPTY))
+			return -1;
+		g = (g + 1) & gmask;
+	}
+}
+
+/*
+ * Intoarce primul slot liber (OA_EMPTY sau OA_DELETED) din secventa de probing
+ * a hash-ului dat. Tabela are mereu cel putin un slot liber.
+ */
+static unsigned int __oa_find_free(oa_hashtable_t *ht, unsigned int hash)
+{
+	unsigned int gmask = ht->hmax / OA_GROUP_WIDTH - 1;
+	unsigned int g = __OA_H1(hash) & gmask;
+
+	while (1) {
+		unsigned int mask = __oa_match_free(ht->ctrl + g * OA_GROUP_WIDTH);
+		if (mask)
+			return g * OA_GROUP_WIDTH + __builtin_ctz(mask);
+		g = (g + 1) & gmask;
+	}
+}
+
+/*
+ * Reconstruieste tabela cu hmax sloturi, reinserand toate intrarile valide.
+ * Tombstone-urile dispar in urma acestei operatii.
+ */
+static void __oa_rehash(oa_hashtable_t *ht, unsigned int hmax)
+{
+	unsigned char *old_ctrl = ht->ctrl;
+	unsigned char *old_keys = ht->keys;
+	unsigned char *old_values = ht->values;
+	unsigned int old_hmax = ht->hmax;
+
+	__oa_alloc_slots(ht, hmax);
+
+	for (unsigned int j = 0; j < old_hmax; j++) {
+		if (old_ctrl[j] & 0x80)
+			continue;
+
+		unsigned char *key = old_keys + (size_t)j * ht->key_size;
+		unsigned int hash = ht->hash_function(key);
+		unsigned int i = __oa_find_free(ht, hash);
+
+		ht->ctrl[i] = __OA_H2(hash);
+		memcpy(__oa_key(ht, i), key, ht->key_size);
+		memcpy(__oa_value(ht, i),
+			old_values + (size_t)j * ht->value_size, ht->value_size);
+		ht->size++;
+	}
+
+	free(old_ctrl);
+	free(old_keys);
+	free(old_values);
+}
+
+/*
+ * Functie care intoarce:
+ * 1, daca pentru cheia key a fost asociata anterior o valoare in hashtable
+ * folosind functia put;
+ * 0, altfel.
+ */
+int oa_ht_has_key(oa_hashtable_t *ht, void *key)
+{
+	return __oa_find(ht, key, ht->hash_function(key)) >= 0;
+}
+
+/*
+ * Atentie! Pointerul intors indica direct in vectorul de valori al tabelei si
+ * ramane valid doar pana la urmatorul apel oa_ht_put (care poate redimensiona
+ * tabela) sau oa_ht_remove_entry pe aceeasi cheie.
+ */
+void *oa_ht_get(oa_hashtable_t *ht, void *key)
+{
+	long i = __oa_find(ht, key, ht->hash_function(key));
+
+	if (i < 0)
+		return NULL;
+
+	return __oa_value(ht, i);
+}
+
+/*
+ * Copiaza key_size octeti din key si value_size octeti din value in slotul
+ * asociat cheii (restul slotului este completat cu 0). Daca cheia exista deja,
+ * doar valoarea este suprascrisa. Tabela este redimensionata cand sloturile
+ * ocupate (inclusiv tombstone-urile) depasesc 3/4 din capacitate.
+ */
+void oa_ht_put(oa_hashtable_t *ht, void *key, unsigned int key_size,
+	void *value, unsigned int value_size)
+{
+	DIE(key_size > ht->key_size, "oa_ht_put key_size");
+	DIE(value_size > ht->value_size, "oa_ht_put value_size");
+
+	unsigned int hash = ht->hash_function(key);
+	long found = __oa_find(ht, key, hash);
+	if (found >= 0) {
+		memset(__oa_value(ht, found), 0, ht->value_size);
+		memcpy(__oa_value(ht, found), value, value_size);
+		return;
+	}
+
+	if ((ht->size + ht->tombstones + 1) * 4 > ht->hmax * 3) {
+		/* Daca majoritatea sloturilor ocupate sunt tombstones, ajunge o
+		 * curatare la aceeasi capacitate. */
+		if (ht->size * 2 >= ht->hmax)
+			__oa_rehash(ht, ht->hmax * 2);
+		else
+			__oa_rehash(ht, ht->hmax);
+	}
+
+	unsigned int i = __oa_find_free(ht, hash);
+	if (ht->ctrl[i] == OA_DELETED)
+		ht->tombstones--;
+	ht->ctrl[i] = __OA_H2(hash);
+	memset(__oa_key(ht, i), 0, ht->key_size);
+	memcpy(__oa_key(ht, i), key, key_size);
+	memset(__oa_value(ht, i), 0, ht->value_size);
+	memcpy(__oa_value(ht, i), value, value_size);
+	ht->size++;
+}
+
+/*
+ * Procedura care elimina din hashtable intrarea asociata cheii key. Daca grupul
+ * slotului mai are un slot OA_EMPTY, orice cautare ce ajunge aici s-ar opri
+ * oricum in acest grup, deci slotul poate redeveni OA_EMPTY; altfel este marcat
+ * OA_DELETED pentru ca secventele de probing ce trec prin el sa ramana intacte.
+ */
+void oa_ht_remove_entry(oa_hashtable_t *ht, void *key)
+{
+	long i = __oa_find(ht, key, ht->hash_function(key));
+
+	if (i < 0)
+		return;
+
+	unsigned char *group = ht->ctrl + (i / OA_GROUP_WIDTH) * OA_GROUP_WIDTH;
+	if (__oa_match(group, OA_EMPTY)) {
+		ht->ctrl[i] = OA_EMPTY;
+	} else {
+		ht->ctrl[i] = OA_DELETED;
+		ht->tombstones++;
+	}
+	ht->size--;
+}
+
+/*
+ * Procedura care elibereaza memoria folosita de hashtable. Cheile si valorile
+ * sunt stocate inline, deci nu mai trebuie eliberate separat.
+ */
+void oa_ht_free(oa_hashtable_t *ht)
+{
+	if (ht == NULL)
+		return;
+
+	free(ht->ctrl);
+	free(ht->keys);
+	free(ht->values);
+	free(ht);
+}
+
+unsigned int oa_ht_get_size(oa_hashtable_t *ht)
+{
+	if (ht == NULL)
+		return 0;
+
+	return ht->size;
+}
+
+unsigned int oa_ht_get_hmax(oa_hashtable_t *ht)
+{
+	if (ht == NULL)
+		return 0;
+
+	return ht->hmax;
+}
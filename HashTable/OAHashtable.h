@@ -0,0 +1,62 @@
+#ifndef __OA_HASHTABLE_H_
+#define __OA_HASHTABLE_H_
+
+#include "Hashtable.h"
+
+/*
+ * Sloturile sunt grupate cate OA_GROUP_WIDTH; octetii de control ai unui grup
+ * sunt comparati deodata cu instructiuni SSE2 (16 octeti) sau AVX2 (32 de
+ * octeti), daca sunt disponibile la compilare, altfel octet cu octet.
+ */
+#if defined(__AVX2__)
+#define OA_GROUP_WIDTH 32
+#else
+#define OA_GROUP_WIDTH 16
+#endif
+
+/* Nr. minim de sloturi; capacitatea este mereu o putere a lui 2. */
+#define OA_HMIN 32
+
+/*
+ * Octetul de control al unui slot: OA_EMPTY, OA_DELETED sau, pentru un slot
+ * ocupat, cei mai putin semnificativi 7 biti ai hash-ului cheii (bitul 7 = 0).
+ */
+#define OA_EMPTY	0x80
+#define OA_DELETED	0xFE
+
+typedef struct oa_hashtable_t oa_hashtable_t;
+struct oa_hashtable_t {
+	/* Octetul de control al fiecarui slot (vezi OA_EMPTY / OA_DELETED). */
+	unsigned char *ctrl;
+	/* Cheile, stocate inline: slotul i incepe la keys + i * key_size. */
+	unsigned char *keys;
+	/* Valorile, stocate inline: slotul i incepe la values + i * value_size. */
+	unsigned char *values;
+	/* Nr. de intrari valide din tabela. */
+	unsigned int size;
+	/* Nr. de sloturi marcate OA_DELETED (tombstones). */
+	unsigned int tombstones;
+	/* Nr. total de sloturi (putere a lui 2). */
+	unsigned int hmax;
+	/* Dimensiunea maxima, in octeti, a unei chei, respectiv a unei valori. */
+	unsigned int key_size;
+	unsigned int value_size;
+	/* (Pointer la) Functie pentru a calcula valoarea hash asociata cheilor. */
+	unsigned int (*hash_function)(void*);
+	/* (Pointer la) Functie pentru a compara doua chei. */
+	int (*compare_function)(void*, void*);
+};
+
+oa_hashtable_t *oa_ht_create(unsigned int hmax, unsigned int key_size,
+		unsigned int value_size, unsigned int (*hash_function)(void*),
+		int (*compare_function)(void*, void*));
+int oa_ht_has_key(oa_hashtable_t *ht, void *key);
+void *oa_ht_get(oa_hashtable_t *ht, void *key);
+void oa_ht_put(oa_hashtable_t *ht, void *key, unsigned int key_size,
+	void *value, unsigned int value_size);
+void oa_ht_remove_entry(oa_hashtable_t *ht, void *key);
+void oa_ht_free(oa_hashtable_t *ht);
+unsigned int oa_ht_get_size(oa_hashtable_t *ht);
+unsigned int oa_ht_get_hmax(oa_hashtable_t *ht);
+
+#endif
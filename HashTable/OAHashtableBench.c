@@ -0,0 +1,96 @@
+/*
+ * Benchmark pentru oa_ht_get comparat cu ht_get (tabela cu liste inlantuite):
+ * ambele tabele primesc aceleasi BENCH_KEYS chei int, apoi se masoara timpul
+ * mediu al unei cautari pentru chei prezente (hit) si absente (miss), in
+ * ordine aleatoare.
+ *
+ * Compilare si rulare (din HashTable/):
+ *	gcc -O2 OAHashtableBench.c OAHashtable.c Hashtable.c -o oa_bench
+ *	./oa_bench [nr_chei]
+ *
+ * Cu -mavx2 se compara grupuri de 32 de octeti de control in loc de 16.
+ */
+#include <time.h>
+
+#include "OAHashtable.h"
+
+#define BENCH_KEYS (1 << 20)
+#define BENCH_LOOKUPS (1 << 23)
+
+/* Generator xorshift32. */
+static inline unsigned int __bench_rand(unsigned int *state)
+{
+	unsigned int x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+static double __bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Face BENCH_LOOKUPS cautari ale unor chei aleatoare din [base, base + n) si
+ * intoarce timpul mediu in ns. found numara cheile gasite, ca apelurile sa nu
+ * poata fi eliminate de compilator.
+ */
+static double __bench_gets(oa_hashtable_t *oa, hashtable_t *ht, int base,
+	unsigned int n, unsigned int *found)
+{
+	unsigned int state = 2463534242u;
+	double start = __bench_now();
+
+	for (unsigned int i = 0; i < BENCH_LOOKUPS; i++) {
+		int key = base + __bench_rand(&state) % n;
+		void *value = oa ? oa_ht_get(oa, &key) : ht_get(ht, &key);
+
+		*found += value != NULL;
+	}
+
+	return (__bench_now() - start) * 1e9 / BENCH_LOOKUPS;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int n = BENCH_KEYS, found = 0;
+
+	if (argc > 1)
+		n = strtoul(argv[1], NULL, 10);
+	if (n == 0 || n > (1u << 30)) {
+		fprintf(stderr, "nr_chei trebuie sa fie intre 1 si 2^30\n");
+		return 1;
+	}
+
+	oa_hashtable_t *oa = oa_ht_create(HMAX, sizeof(int), sizeof(int),
+		hash_function_int, compare_function_ints);
+	hashtable_t *ht = ht_create(HMAX, hash_function_int,
+		compare_function_ints, key_val_free_function);
+	for (int key = 0; key < (int)n; key++) {
+		oa_ht_put(oa, &key, sizeof(key), &key, sizeof(key));
+		ht_put(ht, &key, sizeof(key), &key, sizeof(key));
+	}
+
+	printf("%u chei, %d cautari, grupuri de %d octeti de control\n", n,
+		BENCH_LOOKUPS, OA_GROUP_WIDTH);
+	printf("%8s %14s %14s\n", "", "oa_ht_get (ns)", "ht_get (ns)");
+	printf("%8s %14.1f %14.1f\n", "hit", __bench_gets(oa, NULL, 0, n, &found),
+		__bench_gets(NULL, ht, 0, n, &found));
+	printf("%8s %14.1f %14.1f\n", "miss", __bench_gets(oa, NULL, n, n, &found),
+		__bench_gets(NULL, ht, n, n, &found));
+	if (found != 2u * BENCH_LOOKUPS) {
+		fprintf(stderr, "rezultate gresite: %u chei gasite\n", found);
+		return 1;
+	}
+
+	oa_ht_free(oa);
+	ht_free(ht);
+	return 0;
+}
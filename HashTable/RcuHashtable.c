@@ -0,0 +1,334 @@
+#include "RcuHashtable.h"
+
+/*
+ * Hashtable cu citiri fara lock-uri, pentru incarcari dominate de get-uri.
+ *
+ * Cititorii parcurg lanturile doar cu load-uri acquire, fara lock-uri si fara
+ * operatii atomice read-modify-write. Scriitorii sunt serializati de
+ * write_lock si nu modifica niciodata un nod deja publicat: o valoare noua
+ * inseamna un nod nou, legat in locul celui vechi printr-un singur store
+ * release. Nodurile scoase din lanturi sunt eliberate prin epoch-based
+ * reclamation: un nod retras in epoca e este eliberat abia cand epoca globala
+ * ajunge la e + 2, adica dupa ce toti cititorii activi au trecut printr-o
+ * epoca in care nodul nu mai era accesibil.
+ *
+ * Tabela se dubleaza cand depaseste HT_MAX_LOAD intrari per bucket. Nodurile
+ * publicate nu pot fi mutate sub cititori, asa ca resize-ul construieste un
+ * vector nou cu copii ale nodurilor (aceleasi chei si valori), il publica
+ * printr-un singur store release si retrage vectorul vechi si nodurile lui.
+ * Un cititor aflat inca in tabela veche o parcurge pana la capat nestingherit.
+ * Resize-ul costa O(n) sub write_lock, dar se amortizeaza prin dublare.
+ */
+
+#define __RCU_LOAD(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define __RCU_PUBLISH(ptr, val) __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+
+static rcu_table_t *__rcu_table_create(unsigned int hmax)
+{
+	rcu_table_t *table = calloc(1, sizeof(rcu_table_t) + hmax * sizeof(ll_node_t*));
+	DIE(table == NULL, "rcu_ht table calloc");
+
+	table->hmax = hmax;
+	return table;
+}
+
+/*
+ * Functie apelata pentru a aloca si initializa un hashtable RCU cu hmax
+ * bucket-uri initiale (rotunjit la o putere a lui 2).
+ */
+rcu_hashtable_t *rcu_ht_create(unsigned int hmax,
+		unsigned int (*hash_function)(void*),
+		int (*compare_function)(void*, void*),
+		void (*key_val_free_function)(void*))
+{
+	rcu_hashtable_t *ht = aligned_alloc(64, sizeof(rcu_hashtable_t));
+	DIE(ht == NULL, "rcu_ht aligned_alloc");
+	memset(ht, 0, sizeof(rcu_hashtable_t));
+
+	unsigned int cap = 1;
+	while (cap < hmax)
+		cap <<= 1;
+
+	ht->table = __rcu_table_create(cap);
+	ht->hash_function = hash_function;
+	ht->compare_function = compare_function;
+	ht->key_val_free_function = key_val_free_function;
+	DIE(pthread_mutex_init(&ht->write_lock, NULL) != 0,
+		"rcu_ht pthread_mutex_init");
+
+	return ht;
+}
+
+/*
+ * Inregistreaza un thread cititor si intoarce identificatorul sau, ce trebuie
+ * transmis la rcu_ht_read_lock / rcu_ht_read_unlock.
+ */
+unsigned int rcu_ht_register_reader(rcu_hashtable_t *ht)
+{
+	pthread_mutex_lock(&ht->write_lock);
+	DIE(ht->n_readers == RCU_MAX_READERS, "rcu_ht too many readers");
+	unsigned int id = ht->n_readers++;
+	pthread_mutex_unlock(&ht->write_lock);
+
+	return id;
+}
+
+/*
+ * Intra intr-o sectiune de citire: cititorul isi anunta epoca curenta. Fence-ul
+ * garanteaza ca anuntul este vizibil scriitorilor inainte ca cititorul sa
+ * incarce vreun nod.
+ */
+void rcu_ht_read_lock(rcu_hashtable_t *ht, unsigned int reader)
+{
+	unsigned long epoch = __atomic_load_n(&ht->epoch, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&ht->readers[reader].epoch, (epoch << 1) | 1,
+		__ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/*
+ * Iese din sectiunea de citire. Pointerii obtinuti prin rcu_ht_get nu mai pot
+ * fi folositi dupa acest apel.
+ */
+void rcu_ht_read_unlock(rcu_hashtable_t *ht, unsigned int reader)
+{
+	__atomic_store_n(&ht->readers[reader].epoch, 0, __ATOMIC_RELEASE);
+}
+
+static ll_node_t *__rcu_find(rcu_hashtable_t *ht, void *key, unsigned int hash)
+{
+	rcu_table_t *table = __RCU_LOAD(&ht->table);
+	ll_node_t *iterator = __RCU_LOAD(&table->buckets[hash & (table->hmax - 1)]);
+
+	while (iterator != NULL) {
+		info *curr = (info*)iterator->data;
+		if (curr->hash == hash && !ht->compare_function(key, curr->key))
+			return iterator;
+		iterator = __RCU_LOAD(&iterator->next);
+	}
+
+	return NULL;
+}
+
+/*
+ * Functie care intoarce 1 daca cheia key se afla in tabela si 0 altfel.
+ * Trebuie apelata intre rcu_ht_read_lock si rcu_ht_read_unlock.
+ */
+int rcu_ht_has_key(rcu_hashtable_t *ht, void *key)
+{
+	return __rcu_find(ht, key, ht->hash_function(key)) != NULL;
+}
+
+/*
+ * Atentie! Trebuie apelata intre rcu_ht_read_lock si rcu_ht_read_unlock, iar
+ * valoarea intoarsa ramane valida doar pana la rcu_ht_read_unlock. Valoarea nu
+ * trebuie modificata: alti cititori o pot vedea in acelasi timp.
+ */
+void *rcu_ht_get(rcu_hashtable_t *ht, void *key)
+{
+	ll_node_t *node = __rcu_find(ht, key, ht->hash_function(key));
+
+	if (node == NULL)
+		return NULL;
+
+	return ((info*)node->data)->value;
+}
+
+static void __rcu_release_retired(rcu_hashtable_t *ht, rcu_retired_t *retired)
+{
+	while (retired != NULL) {
+		rcu_retired_t *next = retired->next;
+		if (retired->kind == RCU_RETIRED_ENTRY)
+			ht->key_val_free_function(((ll_node_t*)retired->ptr)->data);
+		free(retired->ptr);
+		free(retired);
+		retired = next;
+	}
+}
+
+/*
+ * Incearca sa avanseze epoca globala si sa elibereze nodurile ce nu mai pot fi
+ * vazute de niciun cititor. Epoca avanseaza doar daca toti cititorii activi au
+ * anuntat epoca curenta. Se apeleaza cu write_lock luat.
+ */
+static void __rcu_try_reclaim(rcu_hashtable_t *ht)
+{
+	unsigned long epoch = ht->epoch;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	for (unsigned int i = 0; i < ht->n_readers; i++) {
+		unsigned long announced = __atomic_load_n(&ht->readers[i].epoch,
+			__ATOMIC_ACQUIRE);
+		if ((announced & 1) && (announced >> 1) != epoch)
+			return;
+	}
+
+	epoch++;
+	__atomic_store_n(&ht->epoch, epoch, __ATOMIC_RELEASE);
+
+	/* Nodurile retrase in epoch - 2 sunt in limbo[(epoch + 1) % 3]. */
+	rcu_retired_t *retired = ht->limbo[(epoch + 1) % 3];
+	ht->limbo[(epoch + 1) % 3] = NULL;
+	__rcu_release_retired(ht, retired);
+}
+
+/*
+ * Amana eliberarea unei zone deja scoase din tabela (vezi RCU_RETIRED_*). Se
+ * apeleaza cu write_lock luat.
+ */
+static void __rcu_retire(rcu_hashtable_t *ht, int kind, void *ptr)
+{
+	rcu_retired_t *retired = malloc(sizeof(*retired));
+	DIE(retired == NULL, "rcu_ht retired malloc");
+
+	retired->kind = kind;
+	retired->ptr = ptr;
+	retired->next = ht->limbo[ht->epoch % 3];
+	ht->limbo[ht->epoch % 3] = retired;
+}
+
+/*
+ * Dubleaza tabela: fiecare nod este copiat in lantul lui din vectorul nou,
+ * care e publicat abia dupa ce este complet. Se apeleaza cu write_lock luat.
+ */
+static void __rcu_resize(rcu_hashtable_t *ht)
+{
+	rcu_table_t *old = ht->table;
+	rcu_table_t *table = __rcu_table_create(old->hmax * 2);
+
+	for (unsigned int i = 0; i < old->hmax; i++) {
+		for (ll_node_t *it = old->buckets[i]; it != NULL; it = it->next) {
+			ll_node_t *copy = malloc(sizeof(*copy));
+			DIE(copy == NULL, "rcu_ht node malloc");
+			copy->data = it->data;
+
+			ll_node_t **link = &table->buckets[((info*)it->data)->hash & (table->hmax - 1)];
+			copy->next = *link;
+			*link = copy;
+		}
+	}
+	__RCU_PUBLISH(&ht->table, table);
+
+	for (unsigned int i = 0; i < old->hmax; i++) {
+		for (ll_node_t *it = old->buckets[i]; it != NULL; it = it->next)
+			__rcu_retire(ht, RCU_RETIRED_NODE, it);
+	}
+	__rcu_retire(ht, RCU_RETIRED_TABLE, old);
+}
+
+/*
+ * La fel ca ht_put, cheia si valoarea sunt copiate. Daca cheia exista deja,
+ * nodul ei este inlocuit cu unul nou (cititorii in curs vad fie valoarea veche,
+ * fie pe cea noua), iar nodul vechi este retras.
+ */
+void rcu_ht_put(rcu_hashtable_t *ht, void *key, unsigned int key_size,
+	void *value, unsigned int value_size)
+{
+	unsigned int hash = ht->hash_function(key);
+
+	info *new = calloc(1, sizeof(info));
+	DIE(new == NULL, "rcu_ht info calloc");
+	new->hash = hash;
+	new->key_size = key_size;
+	new->key = malloc(key_size);
+	DIE(new->key == NULL, "rcu_ht key malloc");
+	memcpy(new->key, key, key_size);
+	new->value_size = value_size;
+	new->value = malloc(value_size);
+	DIE(new->value == NULL, "rcu_ht value malloc");
+	memcpy(new->value, value, value_size);
+
+	ll_node_t *node = malloc(sizeof(*node));
+	DIE(node == NULL, "rcu_ht node malloc");
+	node->data = new;
+
+	pthread_mutex_lock(&ht->write_lock);
+
+	ll_node_t **head = &ht->table->buckets[hash & (ht->table->hmax - 1)];
+	ll_node_t **link = head;
+	while (*link != NULL) {
+		info *curr = (info*)(*link)->data;
+		if (curr->hash == hash && !ht->compare_function(key, curr->key))
+			break;
+		link = &(*link)->next;
+	}
+
+	if (*link != NULL) {
+		ll_node_t *old = *link;
+		node->next = old->next;
+		__RCU_PUBLISH(link, node);
+		__rcu_retire(ht, RCU_RETIRED_ENTRY, old);
+	} else {
+		node->next = *head;
+		__RCU_PUBLISH(head, node);
+		__atomic_fetch_add(&ht->size, 1, __ATOMIC_RELAXED);
+		if (ht->size > ht->table->hmax * HT_MAX_LOAD)
+			__rcu_resize(ht);
+	}
+
+	__rcu_try_reclaim(ht);
+	pthread_mutex_unlock(&ht->write_lock);
+}
+
+/*
+ * Procedura care scoate din tabela intrarea asociata cheii key. Memoria ei este
+ * eliberata mai tarziu, cand niciun cititor nu o mai poate accesa.
+ */
+void rcu_ht_remove_entry(rcu_hashtable_t *ht, void *key)
+{
+	unsigned int hash = ht->hash_function(key);
+
+	pthread_mutex_lock(&ht->write_lock);
+
+	ll_node_t **link = &ht->table->buckets[hash & (ht->table->hmax - 1)];
+	while (*link != NULL) {
+		info *curr = (info*)(*link)->data;
+		if (curr->hash == hash && !ht->compare_function(key, curr->key)) {
+			ll_node_t *old = *link;
+			__RCU_PUBLISH(link, old->next);
+			__rcu_retire(ht, RCU_RETIRED_ENTRY, old);
+			__atomic_fetch_sub(&ht->size, 1, __ATOMIC_RELAXED);
+			break;
+		}
+		link = &(*link)->next;
+	}
+
+	__rcu_try_reclaim(ht);
+	pthread_mutex_unlock(&ht->write_lock);
+}
+
+/*
+ * Procedura care elibereaza toata memoria tabelei, inclusiv nodurile retrase.
+ * Nu trebuie apelata cat timp alte thread-uri mai folosesc tabela.
+ */
+void rcu_ht_free(rcu_hashtable_t *ht)
+{
+	if (ht == NULL)
+		return;
+
+	for (int e = 0; e < 3; e++)
+		__rcu_release_retired(ht, ht->limbo[e]);
+
+	for (unsigned int i = 0; i < ht->table->hmax; i++) {
+		ll_node_t *iterator = ht->table->buckets[i];
+		while (iterator != NULL) {
+			ll_node_t *next = iterator->next;
+			ht->key_val_free_function(iterator->data);
+			free(iterator);
+			iterator = next;
+		}
+	}
+
+	pthread_mutex_destroy(&ht->write_lock);
+	free(ht->table);
+	free(ht);
+}
+
+unsigned int rcu_ht_get_size(rcu_hashtable_t *ht)
+{
+	if (ht == NULL)
+		return 0;
+
+	return __atomic_load_n(&ht->size, __ATOMIC_RELAXED);
+}
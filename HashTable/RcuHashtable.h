@@ -0,0 +1,90 @@
+#ifndef __RCU_HASHTABLE_H_
+#define __RCU_HASHTABLE_H_
+
+#include <pthread.h>
+
+#include "Hashtable.h"
+
+/* Nr. maxim de thread-uri cititoare inregistrate simultan. */
+#define RCU_MAX_READERS 64
+
+/*
+ * Epoca anuntata de un cititor: (epoca << 1) | 1 cat timp se afla intr-o
+ * sectiune de citire, 0 altfel. Aliniata ca fiecare cititor sa aiba propria
+ * linie de cache.
+ */
+typedef struct rcu_reader_t rcu_reader_t;
+struct rcu_reader_t {
+	unsigned long epoch;
+} __attribute__((aligned(64)));
+
+/* Ce contine un rcu_retired_t. */
+/* Un nod scos din tabela, impreuna cu cheia si valoarea lui. */
+#define RCU_RETIRED_ENTRY 0
+/* Doar nodul de lista: cheia si valoarea au trecut intr-o copie (resize). */
+#define RCU_RETIRED_NODE 1
+/* Un vector de bucket-uri inlocuit la resize. */
+#define RCU_RETIRED_TABLE 2
+
+/* Memorie scoasa din tabela, care asteapta ca niciun cititor sa nu o mai vada. */
+typedef struct rcu_retired_t rcu_retired_t;
+struct rcu_retired_t {
+	int kind;
+	void *ptr;
+	rcu_retired_t *next;
+};
+
+/*
+ * Vectorul de bucket-uri si dimensiunea lui, publicate impreuna printr-un
+ * singur pointer, ca un cititor sa nu vada niciodata un hmax nepotrivit.
+ */
+typedef struct rcu_table_t rcu_table_t;
+struct rcu_table_t {
+	/* Nr. de bucket-uri (putere a lui 2). */
+	unsigned int hmax;
+	/* Capetele lanturilor; nodurile sunt publicate cu store-uri release. */
+	ll_node_t *buckets[];
+};
+
+typedef struct rcu_hashtable_t rcu_hashtable_t;
+struct rcu_hashtable_t {
+	/*
+	 * Tabela curenta. Cand are mai mult de HT_MAX_LOAD intrari per bucket,
+	 * un scriitor construieste una de doua ori mai mare si o publica in locul
+	 * ei; cea veche este retrasa ca orice nod scos.
+	 */
+	rcu_table_t *table;
+	/* Nr. de intrari (modificat doar de scriitori, atomic). */
+	unsigned int size;
+	/* Epoca globala. */
+	unsigned long epoch;
+	/* Nodurile retrase in epoca e se afla in limbo[e % 3]. */
+	rcu_retired_t *limbo[3];
+	rcu_reader_t readers[RCU_MAX_READERS];
+	unsigned int n_readers;
+	/* Serializeaza scriitorii (put / remove / inregistrarea cititorilor). */
+	pthread_mutex_t write_lock;
+	/* (Pointer la) Functie pentru a calcula valoarea hash asociata cheilor. */
+	unsigned int (*hash_function)(void*);
+	/* (Pointer la) Functie pentru a compara doua chei. */
+	int (*compare_function)(void*, void*);
+	/* (Pointer la) Functie pentru a elibera memoria ocupata de cheie si valoare. */
+	void (*key_val_free_function)(void*);
+};
+
+rcu_hashtable_t *rcu_ht_create(unsigned int hmax,
+		unsigned int (*hash_function)(void*),
+		int (*compare_function)(void*, void*),
+		void (*key_val_free_function)(void*));
+unsigned int rcu_ht_register_reader(rcu_hashtable_t *ht);
+void rcu_ht_read_lock(rcu_hashtable_t *ht, unsigned int reader);
+void rcu_ht_read_unlock(rcu_hashtable_t *ht, unsigned int reader);
+int rcu_ht_has_key(rcu_hashtable_t *ht, void *key);
+void *rcu_ht_get(rcu_hashtable_t *ht, void *key);
+void rcu_ht_put(rcu_hashtable_t *ht, void *key, unsigned int key_size,
+	void *value, unsigned int value_size);
+void rcu_ht_remove_entry(rcu_hashtable_t *ht, void *key);
+void rcu_ht_free(rcu_hashtable_t *ht);
+unsigned int rcu_ht_get_size(rcu_hashtable_t *ht);
+
+#endif
@@ -0,0 +1,154 @@
+#include "aho_corasick.h"
+
+/* Next state from state on slot: its child, or the next state of its failure */
+static trie_index_t __ac_next(trie_automaton_t *ac, trie_index_t state, int slot) {
+    trie_t *trie = ac->trie;
+
+    while (1) {
+        if (ac->dense_of[state] >= 0)
+            return ac->dense[(size_t)ac->dense_of[state] * trie->alphabet_size + slot];
+
+        trie_node_t *child = trie_node_child(trie, trie_node_at(trie, state), slot);
+        if (child)
+            return child->index;
+        if (state == trie->root->index)
+            return state;
+        state = ac->fail[state];
+    }
+}
+
+trie_automaton_t* trie_build_automaton(trie_t* trie) {
+    size_t row = trie->alphabet_size * sizeof(trie_index_t);
+
+    return trie_build_automaton_dense(trie, TRIE_AUTOMATON_DENSE_BYTES / row);
+}
+
+/*
+ * Builds the automaton of the keys of trie, giving a full transition row to
+ * the first n_dense states in BFS order (the shallow ones, where a scan spends
+ * most of its time). Radix tries are not supported.
+ */
+trie_automaton_t* trie_build_automaton_dense(trie_t* trie, int n_dense) {
+    DIE(trie->radix, "trie_build_automaton on a radix trie");
+
+    trie_automaton_t *ac = calloc(1, sizeof(trie_automaton_t));
+    DIE(ac == NULL, "trie_automaton_t calloc");
+
+    size_t n = trie->pool_used;
+    ac->trie = trie;
+    ac->fail = calloc(n, sizeof(trie_index_t));
+    DIE(ac->fail == NULL, "trie automaton fail calloc");
+    ac->output = calloc(n, sizeof(trie_index_t));
+    DIE(ac->output == NULL, "trie automaton output calloc");
+    ac->depth = calloc(n, sizeof(int));
+    DIE(ac->depth == NULL, "trie automaton depth calloc");
+    ac->dense_of = malloc(n * sizeof(int));
+    DIE(ac->dense_of == NULL, "trie automaton dense_of malloc");
+    for (size_t i = 0; i < n; i++)
+        ac->dense_of[i] = -1;
+
+    if (n_dense > trie->nNodes)
+        n_dense = trie->nNodes;
+    if (n_dense > 0) {
+        ac->dense = malloc((size_t)n_dense * trie->alphabet_size * sizeof(trie_index_t));
+        DIE(ac->dense == NULL, "trie automaton dense malloc");
+    }
+
+    trie_index_t *queue = malloc(n * sizeof(trie_index_t));
+    DIE(queue == NULL, "trie automaton queue malloc");
+
+    /*
+     * BFS: the failure of a state is shallower, so its links (and its dense
+     * row) are complete by the time the state is dequeued.
+     */
+    trie_index_t root = trie->root->index;
+    size_t head = 0, tail = 0;
+    queue[tail++] = root;
+    while (head < tail) {
+        trie_index_t state = queue[head++];
+        trie_node_t *node = trie_node_at(trie, state), *child;
+        int slot = -1;
+
+        while ((child = trie_node_next_child(trie, node, slot + 1, &slot)) != NULL) {
+            trie_index_t next = child->index;
+
+            ac->fail[next] = state == root ? root : __ac_next(ac, ac->fail[state], slot);
+            ac->depth[next] = ac->depth[state] + 1;
+            ac->output[next] = child->end_of_word ? next : ac->output[ac->fail[next]];
+            queue[tail++] = next;
+        }
+
+        if (ac->n_dense < n_dense) {
+            trie_index_t *row = ac->dense + (size_t)ac->n_dense * trie->alphabet_size;
+            for (slot = 0; slot < trie->alphabet_size; slot++) {
+                child = trie_node_child(trie, node, slot);
+                if (child)
+                    row[slot] = child->index;
+                else
+                    row[slot] = state == root ? root : __ac_next(ac, ac->fail[state], slot);
+            }
+            ac->dense_of[state] = ac->n_dense++;
+        }
+    }
+    free(queue);
+
+    ac->state = root;
+    return ac;
+}
+
+/*
+ * Feeds the next len bytes of the stream to the automaton and calls cb for
+ * every key found, with its start offset in the stream (counted from the
+ * last trie_automaton_reset), its length and its value. A byte outside the
+ * alphabet restarts matching at the root. Returns the number of matches.
+ */
+int trie_scan(trie_automaton_t* ac, const char* buf, size_t len,
+              void (*cb)(size_t pos, int len, void* value, void* arg), void* arg) {
+    trie_t *trie = ac->trie;
+    trie_index_t root = trie->root->index, state = ac->state;
+    int found = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        int slot = trie->slot_of[(unsigned char)buf[i]];
+        if (slot < 0) {
+            state = root;
+            continue;
+        }
+        int row = ac->dense_of[state];
+        if (row >= 0)
+            state = ac->dense[(size_t)row * trie->alphabet_size + slot];
+        else
+            state = __ac_next(ac, state, slot);
+
+        for (trie_index_t out = ac->output[state]; out; out = ac->output[ac->fail[out]]) {
+            size_t end = ac->offset + i + 1;
+            cb(end - ac->depth[out], ac->depth[out], trie_node_at(trie, out)->value, arg);
+            found++;
+        }
+    }
+
+    ac->state = state;
+    ac->offset += len;
+    return found;
+}
+
+/* Starts a new stream */
+void trie_automaton_reset(trie_automaton_t* ac) {
+    ac->state = ac->trie->root->index;
+    ac->offset = 0;
+}
+
+void trie_automaton_free(trie_automaton_t** pAc) {
+    trie_automaton_t *ac = *pAc;
+
+    if (ac == NULL)
+        return;
+
+    free(ac->fail);
+    free(ac->output);
+    free(ac->depth);
+    free(ac->dense_of);
+    free(ac->dense);
+    free(ac);
+    *pAc = NULL;
+}
@@ -0,0 +1,46 @@
+#ifndef AHO_CORASICK_H
+#define AHO_CORASICK_H
+
+#include "trie.h"
+
+/* Memory of the full transition rows given by default to the shallowest states */
+#define TRIE_AUTOMATON_DENSE_BYTES (1 << 20)
+
+/*
+ * Aho-Corasick automaton over the keys of a trie_t: its states are the trie
+ * nodes, and every array below is indexed by pool index. The trie must not be
+ * modified (nor freed) while the automaton is in use.
+ */
+typedef struct trie_automaton_t trie_automaton_t;
+struct trie_automaton_t {
+    trie_t* trie;
+
+    /* Longest proper suffix of the state's key that is also a state */
+    trie_index_t* fail;
+    /* First state holding a key on the chain state, fail[state], ... (0 if none) */
+    trie_index_t* output;
+    /* Key length of each state */
+    int* depth;
+
+    /*
+     * Dense states: row dense_of[state] of dense (alphabet_size entries)
+     * holds the next state for every slot, failure links included; -1 for the
+     * other states, which follow the failure links at scan time.
+     */
+    int* dense_of;
+    trie_index_t* dense;
+    int n_dense;
+
+    /* Scan position, kept between trie_scan calls */
+    trie_index_t state;
+    size_t offset;
+};
+
+trie_automaton_t* trie_build_automaton(trie_t* trie);
+trie_automaton_t* trie_build_automaton_dense(trie_t* trie, int n_dense);
+int trie_scan(trie_automaton_t* ac, const char* buf, size_t len,
+              void (*cb)(size_t pos, int len, void* value, void* arg), void* arg);
+void trie_automaton_reset(trie_automaton_t* ac);
+void trie_automaton_free(trie_automaton_t** ac);
+
+#endif
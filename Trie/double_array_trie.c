@@ -0,0 +1,320 @@
+#include "double_array_trie.h"
+
+/*
+ * Free cells form a circular doubly linked list, kept in the cells themselves:
+ * check = -(next + 1) and base = -(prev + 1), so check stays negative.
+ */
+#define __DA_NEXT(da, i) (-(da)->check[i] - 1)
+#define __DA_PREV(da, i) (-(da)->base[i] - 1)
+
+static void __da_link(da_trie_t *da, int i, int prev, int next) {
+    da->check[i] = -(next + 1);
+    da->base[i] = -(prev + 1);
+}
+
+/* Adds cell i to the free list, before the head (i.e. at the tail) */
+static void __da_release(da_trie_t *da, int i) {
+    da->value[i] = -1;
+    if (da->free_head < 0) {
+        __da_link(da, i, i, i);
+        da->free_head = i;
+        return;
+    }
+
+    int head = da->free_head, tail = __DA_PREV(da, head);
+    __da_link(da, i, tail, head);
+    da->check[tail] = -(i + 1);
+    da->base[head] = -(i + 1);
+}
+
+/* Makes room for cells [0, need) */
+static void __da_reserve(da_trie_t *da, int need) {
+    if (need <= da->capacity)
+        return;
+
+    int capacity = da->capacity ? da->capacity : 256;
+    while (capacity < need)
+        capacity *= 2;
+
+    da->base = realloc(da->base, capacity * sizeof(int));
+    DIE(da->base == NULL, "da_trie base realloc");
+    da->check = realloc(da->check, capacity * sizeof(int));
+    DIE(da->check == NULL, "da_trie check realloc");
+    da->value = realloc(da->value, capacity * sizeof(int));
+    DIE(da->value == NULL, "da_trie value realloc");
+
+    int old_capacity = da->capacity;
+    da->capacity = capacity;
+    for (int i = old_capacity; i < capacity; i++)
+        __da_release(da, i);
+}
+
+/* Takes cell t off the free list and marks it as a child of s */
+static void __da_occupy(da_trie_t *da, int t, int s) {
+    int prev = __DA_PREV(da, t), next = __DA_NEXT(da, t);
+
+    if (next == t) {
+        da->free_head = -1;
+    } else {
+        da->check[prev] = -(next + 1);
+        da->base[next] = -(prev + 1);
+        if (da->free_head == t)
+            da->free_head = next;
+    }
+    da->check[t] = s;
+    da->base[t] = 0;
+    da->value[t] = -1;
+}
+
+/*
+ * alphabet works as for trie_create: alphabet_size distinct characters, or
+ * NULL (with TRIE_BYTE_ALPHABET_SIZE) for any byte value.
+ */
+da_trie_t* da_trie_create(int data_size, int alphabet_size, char* alphabet) {
+    DIE(alphabet_size <= 0 || alphabet_size > TRIE_BYTE_ALPHABET_SIZE, "da_trie alphabet_size");
+    DIE(alphabet == NULL && alphabet_size != TRIE_BYTE_ALPHABET_SIZE, "da_trie byte alphabet_size");
+
+    da_trie_t *da = calloc(1, sizeof(da_trie_t));
+    DIE(da == NULL, "da_trie calloc");
+
+    da->data_size = data_size;
+    da->alphabet_size = alphabet_size;
+    for (int slot = 0; slot < alphabet_size; slot++) {
+        unsigned char c = alphabet ? (unsigned char)alphabet[slot] : slot;
+        DIE(da->code_of[c] != 0, "da_trie duplicate alphabet character");
+        da->code_of[c] = slot + 1;
+    }
+
+    da->free_head = -1;
+    __da_reserve(da, alphabet_size + 1);
+    __da_occupy(da, 0, 0);
+    return da;
+}
+
+/*
+ * Returns a base b >= 1 such that b + codes[i] is free for every i. Only the
+ * free cells are tried as the place of the smallest code.
+ */
+static int __da_find_base(da_trie_t *da, const int *codes, int n) {
+    int lo = codes[0], hi = codes[0];
+    for (int i = 1; i < n; i++) {
+        if (codes[i] < lo)
+            lo = codes[i];
+        if (codes[i] > hi)
+            hi = codes[i];
+    }
+
+    int f = da->free_head;
+    while (1) {
+        /* Past the end of the arrays every cell is free */
+        int b = f >= 0 ? f - lo : (da->capacity - lo > 1 ? da->capacity - lo : 1);
+        if (b >= 1) {
+            __da_reserve(da, b + hi + 1);
+            int i = 0;
+            while (i < n && da->check[b + codes[i]] < 0)
+                i++;
+            if (i == n) {
+                /* Next fit: the next search starts here */
+                if (f >= 0)
+                    da->free_head = f;
+                return b;
+            }
+        }
+        if (f < 0)
+            continue;
+        f = __DA_NEXT(da, f);
+        if (f == da->free_head)
+            f = -1;
+    }
+}
+
+/* Codes of the children of s, in increasing order; returns their number */
+static int __da_children(da_trie_t *da, int s, int *codes) {
+    int n = 0;
+
+    if (da->base[s] <= 0)
+        return 0;
+    for (int c = 1; c <= da->alphabet_size && da->base[s] + c < da->capacity; c++) {
+        if (da->check[da->base[s] + c] == s)
+            codes[n++] = c;
+    }
+    return n;
+}
+
+/*
+ * Gives s a base where its current children plus code c all fit, moving the
+ * children (and redirecting the check of their own children) there.
+ */
+static void __da_relocate(da_trie_t *da, int s, int c) {
+    int codes[TRIE_BYTE_ALPHABET_SIZE + 1], grand[TRIE_BYTE_ALPHABET_SIZE];
+    int n = __da_children(da, s, codes);
+
+    codes[n] = c;
+    int b = __da_find_base(da, codes, n + 1);
+
+    for (int i = 0; i < n; i++) {
+        int old_t = da->base[s] + codes[i], new_t = b + codes[i];
+
+        __da_occupy(da, new_t, s);
+        da->base[new_t] = da->base[old_t];
+        da->value[new_t] = da->value[old_t];
+
+        int n_grand = __da_children(da, old_t, grand);
+        for (int j = 0; j < n_grand; j++)
+            da->check[da->base[old_t] + grand[j]] = new_t;
+
+        __da_release(da, old_t);
+    }
+    da->base[s] = b;
+}
+
+/* Returns the state reached from s on code c, creating it if needed */
+static int __da_step_or_add(da_trie_t *da, int s, int c) {
+    int t = da->base[s] + c;
+
+    if (da->base[s] && t < da->capacity && da->check[t] == s)
+        return t;
+
+    if (!da->base[s] || t >= da->capacity || da->check[t] >= 0) {
+        __da_relocate(da, s, c);
+        t = da->base[s] + c;
+    }
+    __da_occupy(da, t, s);
+    return t;
+}
+
+/* Copies value into the value slot of state s, allocating one if needed */
+static void __da_set_value(da_trie_t *da, int s, const void *value) {
+    if (da->value[s] < 0) {
+        if (da->size == da->values_cap) {
+            da->values_cap = da->values_cap ? da->values_cap * 2 : 16;
+            da->values = realloc(da->values, (size_t)da->values_cap * da->data_size);
+            DIE(da->values == NULL, "da_trie values realloc");
+        }
+        da->value[s] = da->size++;
+    }
+    memcpy(da->values + (size_t)da->value[s] * da->data_size, value, da->data_size);
+}
+
+/*
+ * Inserts (or overwrites) key. Returns 0 on success or -1 (leaving the trie
+ * unchanged) if key has a character outside the alphabet.
+ */
+int da_trie_insert_len(da_trie_t* da, const char* key, int len, void* value) {
+    for (int i = 0; i < len; i++) {
+        if (!da->code_of[(unsigned char)key[i]])
+            return -1;
+    }
+
+    int s = 0;
+    for (int i = 0; i < len; i++)
+        s = __da_step_or_add(da, s, da->code_of[(unsigned char)key[i]]);
+    __da_set_value(da, s, value);
+    return 0;
+}
+
+int da_trie_insert(da_trie_t* da, char* key, void* value) {
+    return da_trie_insert_len(da, key, strlen(key), value);
+}
+
+void* da_trie_search_len(da_trie_t* da, const char* key, int len) {
+    int s = 0;
+
+    for (int i = 0; i < len; i++) {
+        int t = da->base[s] + da->code_of[(unsigned char)key[i]];
+        if (t == da->base[s] || t >= da->capacity || da->check[t] != s)
+            return NULL;
+        s = t;
+    }
+
+    if (da->value[s] < 0)
+        return NULL;
+    return da->values + (size_t)da->value[s] * da->data_size;
+}
+
+void* da_trie_search(da_trie_t* da, char* key) {
+    return da_trie_search_len(da, key, strlen(key));
+}
+
+/*
+ * Places the keys [lo, hi), which share their first depth characters and lead
+ * to state s. All the children of a state are placed at once, so no state is
+ * ever moved.
+ */
+static void __da_build(da_trie_t *da, char **keys, int *lens, unsigned char *values,
+                       int lo, int hi, int depth, int s) {
+    int codes[TRIE_BYTE_ALPHABET_SIZE], n = 0;
+
+    if (lens[lo] == depth)
+        __da_set_value(da, s, values + (size_t)lo++ * da->data_size);
+
+    for (int i = lo; i < hi; i++) {
+        if (i == lo || keys[i][depth] != keys[i - 1][depth])
+            codes[n++] = da->code_of[(unsigned char)keys[i][depth]];
+    }
+    if (!n)
+        return;
+
+    int b = __da_find_base(da, codes, n);
+    da->base[s] = b;
+    for (int i = 0; i < n; i++)
+        __da_occupy(da, b + codes[i], s);
+
+    for (int i = lo, group = 0; i < hi; group++) {
+        int j = i + 1;
+        while (j < hi && keys[j][depth] == keys[i][depth])
+            j++;
+        __da_build(da, keys, lens, values, i, j, depth + 1, b + codes[group]);
+        i = j;
+    }
+}
+
+/*
+ * Builds an empty trie from n keys sorted in increasing byte order, without
+ * duplicates (values holds their n values, data_size bytes each). Placing all
+ * the children of a state together avoids the relocations of incremental
+ * inserts and packs the arrays tighter. Returns 0 on success or -1 (leaving
+ * the trie unchanged) if the trie is not empty or the keys are not valid.
+ */
+int da_trie_build(da_trie_t* da, char** keys, int* lens, void* values, int n) {
+    if (da->size != 0)
+        return -1;
+
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < lens[i]; j++) {
+            if (!da->code_of[(unsigned char)keys[i][j]])
+                return -1;
+        }
+        if (i > 0) {
+            int common = lens[i - 1] < lens[i] ? lens[i - 1] : lens[i];
+            int cmp = memcmp(keys[i - 1], keys[i], common);
+            if (cmp > 0 || (cmp == 0 && lens[i - 1] >= lens[i]))
+                return -1;
+        }
+    }
+
+    if (n > 0)
+        __da_build(da, keys, lens, values, 0, n, 0, 0);
+    return 0;
+}
+
+int da_trie_get_size(da_trie_t* da) {
+    if (da == NULL)
+        return 0;
+
+    return da->size;
+}
+
+void da_trie_free(da_trie_t** pDa) {
+    da_trie_t *da = *pDa;
+
+    if (da == NULL)
+        return;
+
+    free(da->base);
+    free(da->check);
+    free(da->value);
+    free(da->values);
+    free(da);
+    *pDa = NULL;
+}
@@ -0,0 +1,43 @@
+#ifndef DOUBLE_ARRAY_TRIE_H
+#define DOUBLE_ARRAY_TRIE_H
+
+#include "trie.h"
+
+/*
+ * Double-array trie: state s goes on character code c to t = base[s] + c,
+ * which is valid only if check[t] == s. Codes are alphabet positions + 1;
+ * state 0 is the root and free cells have a negative check. Values are stored
+ * inline (data_size bytes each), so no free callback is needed.
+ */
+typedef struct da_trie_t da_trie_t;
+struct da_trie_t {
+    int* base;
+    int* check;
+    /* Index of the value of each state in values, or -1 */
+    int* value;
+    int capacity;
+
+    /* Number of keys and their values, data_size bytes each */
+    int size;
+    int data_size;
+    unsigned char* values;
+    int values_cap;
+
+    /* Code of each byte value (0 if not in the alphabet) */
+    int alphabet_size;
+    short code_of[TRIE_BYTE_ALPHABET_SIZE];
+
+    /* A cell of the free list (see double_array_trie.c), or -1 */
+    int free_head;
+};
+
+da_trie_t* da_trie_create(int data_size, int alphabet_size, char* alphabet);
+int da_trie_insert(da_trie_t* da, char* key, void* value);
+int da_trie_insert_len(da_trie_t* da, const char* key, int len, void* value);
+void* da_trie_search(da_trie_t* da, char* key);
+void* da_trie_search_len(da_trie_t* da, const char* key, int len);
+int da_trie_build(da_trie_t* da, char** keys, int* lens, void* values, int n);
+int da_trie_get_size(da_trie_t* da);
+void da_trie_free(da_trie_t** da);
+
+#endif
@@ -0,0 +1,397 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "frozen_trie.h"
+
+/*
+ * Read-only LOUDS encoding of a trie_t: about 2 bits of tree shape, one label
+ * byte and one terminal bit per node, plus small rank/select directories.
+ * Radix labels are expanded to one node per character, so the encoding does
+ * not depend on the mode of the source trie.
+ */
+
+#define __FT_ALIGN8(x) (((unsigned long long)(x) + 7ull) & ~7ull)
+#define __FT_WORDS(bits) (((unsigned long long)(bits) + 63) / 64)
+
+/*
+ * Node of the source trie during the BFS. pos < node->label_len stands for
+ * the implicit node before label[pos] (whose only child is pos + 1); pos =
+ * node->label_len is node itself.
+ */
+typedef struct {
+    trie_node_t *node;
+    int pos;
+} __ft_bfs_node_t;
+
+static void __ft_push(__ft_bfs_node_t **queue, unsigned int *n, unsigned int *cap,
+                      trie_node_t *node, int pos) {
+    if (*n == *cap) {
+        *cap = *cap ? *cap * 2 : 64;
+        *queue = realloc(*queue, *cap * sizeof(__ft_bfs_node_t));
+        DIE(*queue == NULL, "trie_freeze queue realloc");
+    }
+    (*queue)[(*n)++] = (__ft_bfs_node_t){node, pos};
+}
+
+static inline void __ft_set_bit(unsigned long long *bits, unsigned long long i) {
+    bits[i / 64] |= 1ull << (i % 64);
+}
+
+static inline int __ft_get_bit(const unsigned long long *bits, unsigned long long i) {
+    return (bits[i / 64] >> (i % 64)) & 1;
+}
+
+/* rank[w] = number of 1s in the words before w */
+static void __ft_build_rank(const unsigned long long *bits, unsigned int *rank,
+                            unsigned long long words) {
+    unsigned int count = 0;
+
+    for (unsigned long long w = 0; w < words; w++) {
+        rank[w] = count;
+        count += __builtin_popcountll(bits[w]);
+    }
+}
+
+static void __ft_set_pointers(frozen_trie_t *ft) {
+    frozen_trie_header_t *header = (frozen_trie_header_t*)ft->base;
+
+    ft->header = header;
+    ft->louds = (unsigned long long*)(ft->base + header->louds);
+    ft->louds_rank = (unsigned int*)(ft->base + header->louds_rank);
+    ft->louds_select = (unsigned int*)(ft->base + header->louds_select);
+    ft->labels = ft->base + header->labels;
+    ft->end = (unsigned long long*)(ft->base + header->end);
+    ft->end_rank = (unsigned int*)(ft->base + header->end_rank);
+    ft->values = ft->base + header->values;
+}
+
+/*
+ * Sets the array offsets of an image with n nodes and n_keys values of
+ * data_size bytes in layout and returns the size of the image.
+ */
+static unsigned long long __ft_layout(frozen_trie_header_t *layout, unsigned int n,
+                                      unsigned int n_keys, unsigned int data_size) {
+    unsigned long long louds_words = __FT_WORDS(2ull * n - 1);
+    unsigned long long end_words = __FT_WORDS(n);
+    unsigned long long samples = n / FROZEN_TRIE_SELECT_STEP + 1;
+
+    unsigned long long off = __FT_ALIGN8(sizeof(frozen_trie_header_t));
+    layout->louds = off;
+    off += louds_words * sizeof(unsigned long long);
+    layout->louds_rank = off;
+    off = __FT_ALIGN8(off + louds_words * sizeof(unsigned int));
+    layout->louds_select = off;
+    off = __FT_ALIGN8(off + samples * sizeof(unsigned int));
+    layout->end = off;
+    off += end_words * sizeof(unsigned long long);
+    layout->end_rank = off;
+    off = __FT_ALIGN8(off + end_words * sizeof(unsigned int));
+    layout->labels = off;
+    off = __FT_ALIGN8(off + n - 1);
+    layout->values = off;
+    off += (unsigned long long)n_keys * data_size;
+    layout->file_size = off;
+    return off;
+}
+
+/*
+ * Builds the LOUDS image of trie. The trie is left untouched and the frozen
+ * copy holds its own copy of every value (data_size bytes each).
+ */
+frozen_trie_t* trie_freeze(trie_t* trie) {
+    __ft_bfs_node_t *queue = NULL;
+    unsigned int n = 0, cap = 0;
+    unsigned int n_keys = 0;
+
+    /* BFS order; the queue ends up holding every node */
+    __ft_push(&queue, &n, &cap, trie->root, 0);
+    for (unsigned int i = 0; i < n; i++) {
+        trie_node_t *node = queue[i].node;
+        if (queue[i].pos < node->label_len) {
+            __ft_push(&queue, &n, &cap, node, queue[i].pos + 1);
+            continue;
+        }
+        n_keys += node->end_of_word;
+
+        trie_node_t *child;
+        int slot = -1;
+        while ((child = trie_node_next_child(trie, node, slot + 1, &slot)) != NULL)
+            __ft_push(&queue, &n, &cap, child, 0);
+    }
+
+    unsigned long long louds_words = __FT_WORDS(2ull * n - 1);
+    unsigned long long end_words = __FT_WORDS(n);
+
+    frozen_trie_header_t layout;
+    memset(&layout, 0, sizeof(layout));
+
+    frozen_trie_t *ft = calloc(1, sizeof(frozen_trie_t));
+    DIE(ft == NULL, "frozen_trie_t calloc");
+    ft->length = __ft_layout(&layout, n, n_keys, trie->data_size);
+    ft->base = calloc(1, ft->length);
+    DIE(ft->base == NULL, "frozen_trie image calloc");
+
+    memcpy(layout.magic, FROZEN_TRIE_MAGIC, sizeof(layout.magic));
+    layout.n_nodes = n;
+    layout.n_keys = n_keys;
+    layout.data_size = trie->data_size;
+    memcpy(layout.slot_of, trie->slot_of, sizeof(layout.slot_of));
+    memcpy(ft->base, &layout, sizeof(layout));
+    __ft_set_pointers(ft);
+
+    /* Degrees in unary, edge labels and values, all in BFS order */
+    unsigned long long bit = 0, edge = 0, zeros = 0;
+    unsigned int key = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        trie_node_t *node = queue[i].node;
+        int pos = queue[i].pos;
+
+        if (pos < node->label_len) {
+            ft->labels[edge++] = trie->slot_of[(unsigned char)node->label[pos]];
+            __ft_set_bit(ft->louds, bit++);
+        } else {
+            trie_node_t *child;
+            int slot = -1;
+            while ((child = trie_node_next_child(trie, node, slot + 1, &slot)) != NULL) {
+                ft->labels[edge++] = slot;
+                __ft_set_bit(ft->louds, bit++);
+            }
+            if (node->end_of_word) {
+                __ft_set_bit(ft->end, i);
+                memcpy(ft->values + (size_t)key++ * trie->data_size,
+                       node->value, trie->data_size);
+            }
+        }
+
+        if (zeros % FROZEN_TRIE_SELECT_STEP == 0)
+            ft->louds_select[zeros / FROZEN_TRIE_SELECT_STEP] = bit / 64;
+        zeros++;
+        bit++;
+    }
+
+    __ft_build_rank(ft->louds, ft->louds_rank, louds_words);
+    __ft_build_rank(ft->end, ft->end_rank, end_words);
+    free(queue);
+    return ft;
+}
+
+/* Position of the j-th 0 (from 0) of the LOUDS bitvector */
+static unsigned long long __ft_select0(frozen_trie_t *ft, unsigned long long j) {
+    unsigned long long w = ft->louds_select[j / FROZEN_TRIE_SELECT_STEP];
+
+    /* Zeros before word w + 1 = 64 * (w + 1) - ones before word w + 1 */
+    unsigned long long words = __FT_WORDS(2ull * ft->header->n_nodes - 1);
+    while (w + 1 < words && 64 * (w + 1) - ft->louds_rank[w + 1] <= j)
+        w++;
+
+    unsigned long long zeros = ~ft->louds[w];
+    for (unsigned long long r = j - (64 * w - ft->louds_rank[w]); r; r--)
+        zeros &= zeros - 1;
+    return 64 * w + __builtin_ctzll(zeros);
+}
+
+/* Returns the child of node k on slot, or -1 */
+static long long __ft_child(frozen_trie_t *ft, unsigned long long k, int slot) {
+    unsigned long long start = k ? __ft_select0(ft, k - 1) + 1 : 0;
+
+    /* Edges of node k: from (ones before start) = start - k, up to the next 0 */
+    unsigned long long degree = 0;
+    while (__ft_get_bit(ft->louds, start + degree))
+        degree++;
+
+    unsigned long long first = start - k, last = first + degree, end = last;
+    while (first < last) {
+        unsigned long long mid = first + (last - first) / 2;
+        if (ft->labels[mid] < slot)
+            first = mid + 1;
+        else
+            last = mid;
+    }
+    if (first < end && ft->labels[first] == slot)
+        return first + 1;
+    return -1;
+}
+
+void* frozen_trie_search_len(frozen_trie_t* ft, const char* key, int len) {
+    unsigned long long k = 0;
+
+    for (int i = 0; i < len; i++) {
+        int slot = ft->header->slot_of[(unsigned char)key[i]];
+        if (slot < 0)
+            return NULL;
+        long long child = __ft_child(ft, k, slot);
+        if (child < 0)
+            return NULL;
+        k = child;
+    }
+
+    if (!__ft_get_bit(ft->end, k))
+        return NULL;
+
+    unsigned long long rank = ft->end_rank[k / 64] +
+        __builtin_popcountll(ft->end[k / 64] & ((1ull << (k % 64)) - 1));
+    return ft->values + rank * ft->header->data_size;
+}
+
+void* frozen_trie_search(frozen_trie_t* ft, char* key) {
+    return frozen_trie_search_len(ft, key, strlen(key));
+}
+
+int frozen_trie_get_size(frozen_trie_t* ft) {
+    if (ft == NULL)
+        return 0;
+
+    return ft->header->n_keys;
+}
+
+/*
+ * Writes the image to path (through path + ".tmp", renamed at the end).
+ * Returns 0 on success and -1 (with errno set) on failure. Only the bytes of
+ * the values are saved, so values holding pointers are not valid once the
+ * file is opened again.
+ */
+int frozen_trie_save(frozen_trie_t* ft, const char* path) {
+    size_t tmp_len = strlen(path) + 5;
+    char *tmp = malloc(tmp_len);
+    DIE(tmp == NULL, "frozen_trie_save path malloc");
+    snprintf(tmp, tmp_len, "%s.tmp", path);
+
+    int rc = -1;
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        goto out;
+
+    size_t written = 0;
+    while (written < ft->length) {
+        ssize_t bytes = write(fd, ft->base + written, ft->length - written);
+        if (bytes < 0)
+            break;
+        written += bytes;
+    }
+    if (written == ft->length && fsync(fd) == 0)
+        rc = 0;
+
+    if (close(fd) < 0)
+        rc = -1;
+    if (rc == 0 && rename(tmp, path) < 0)
+        rc = -1;
+    if (rc < 0)
+        unlink(tmp);
+out:
+    free(tmp);
+    return rc;
+}
+
+/*
+ * Checks that a mapped image has the layout trie_freeze gives its n_nodes,
+ * n_keys and data_size, that its rank/select directories match its bits and
+ * that it has n_nodes - 1 edges and n_keys end bits. Lookups in an image that
+ * passes stay inside it. Returns 0 if the image is consistent, -1 otherwise.
+ */
+static int __ft_check(frozen_trie_t *ft) {
+    frozen_trie_header_t *header = ft->header, layout;
+    unsigned long long n = header->n_nodes;
+
+    if (n == 0 || header->n_keys > n)
+        return -1;
+    if (__ft_layout(&layout, n, header->n_keys, header->data_size) != header->file_size ||
+        header->louds != layout.louds || header->louds_rank != layout.louds_rank ||
+        header->louds_select != layout.louds_select || header->end != layout.end ||
+        header->end_rank != layout.end_rank || header->labels != layout.labels ||
+        header->values != layout.values)
+        return -1;
+
+    /* LOUDS: 2n - 1 bits (zero padding), n - 1 ones and every 64th zero sampled */
+    unsigned long long bits = 2 * n - 1, ones = 0, zeros = 0, sample = 0;
+    for (unsigned long long w = 0; w < __FT_WORDS(bits); w++) {
+        unsigned long long valid = bits - 64 * w < 64 ? bits - 64 * w : 64;
+        if (valid < 64 && ft->louds[w] >> valid)
+            return -1;
+        if (ft->louds_rank[w] != ones)
+            return -1;
+
+        unsigned long long count = __builtin_popcountll(ft->louds[w]);
+        ones += count;
+        zeros += valid - count;
+        for (; sample * FROZEN_TRIE_SELECT_STEP < zeros; sample++)
+            if (ft->louds_select[sample] != w)
+                return -1;
+    }
+    if (ones != n - 1)
+        return -1;
+
+    /* End bits: n bits (zero padding) and n_keys ones */
+    unsigned long long keys = 0;
+    for (unsigned long long w = 0; w < __FT_WORDS(n); w++) {
+        unsigned long long valid = n - 64 * w < 64 ? n - 64 * w : 64;
+        if (valid < 64 && ft->end[w] >> valid)
+            return -1;
+        if (ft->end_rank[w] != keys)
+            return -1;
+        keys += __builtin_popcountll(ft->end[w]);
+    }
+    return keys == header->n_keys ? 0 : -1;
+}
+
+/*
+ * Maps (read-only) an image written by frozen_trie_save. Returns NULL (with
+ * errno set) on failure.
+ */
+frozen_trie_t* frozen_trie_open_mmap(const char* path) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return NULL;
+    }
+    if ((size_t)st.st_size < sizeof(frozen_trie_header_t)) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    unsigned char *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    frozen_trie_header_t *header = (frozen_trie_header_t*)base;
+    if (memcmp(header->magic, FROZEN_TRIE_MAGIC, sizeof(header->magic)) ||
+        header->file_size != (unsigned long long)st.st_size) {
+        munmap(base, st.st_size);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    frozen_trie_t *ft = calloc(1, sizeof(frozen_trie_t));
+    DIE(ft == NULL, "frozen_trie_t calloc");
+    ft->base = base;
+    ft->length = st.st_size;
+    ft->mapped = 1;
+    __ft_set_pointers(ft);
+    if (__ft_check(ft) < 0) {
+        frozen_trie_free(&ft);
+        errno = EINVAL;
+        return NULL;
+    }
+    return ft;
+}
+
+void frozen_trie_free(frozen_trie_t** pFt) {
+    frozen_trie_t *ft = *pFt;
+
+    if (ft == NULL)
+        return;
+
+    if (ft->mapped)
+        munmap(ft->base, ft->length);
+    else
+        free(ft->base);
+    free(ft);
+    *pFt = NULL;
+}
@@ -0,0 +1,68 @@
+#ifndef FROZEN_TRIE_H
+#define FROZEN_TRIE_H
+
+#include "trie.h"
+
+#define FROZEN_TRIE_MAGIC "FTRIE001"
+
+/* One sample of the select structure every FROZEN_TRIE_SELECT_STEP zeros */
+#define FROZEN_TRIE_SELECT_STEP 64
+
+/*
+ * Header of a frozen trie image. Every array is referenced by its offset from
+ * the start of the image, so the same bytes work in memory and mmap-ed from a
+ * file written by frozen_trie_save.
+ *
+ * Nodes are numbered in BFS order (the root is 0). The LOUDS bitvector holds,
+ * for every node, one 1 per child followed by a 0; the children of all nodes
+ * get consecutive numbers, so child i of node k is node (edges before k) + i
+ * + 1. labels[e] is the alphabet slot of edge e (the edge into node e + 1).
+ */
+typedef struct frozen_trie_header_t frozen_trie_header_t;
+struct frozen_trie_header_t {
+    char magic[8];
+    unsigned int n_nodes;
+    unsigned int n_keys;
+    unsigned int data_size;
+    unsigned int pad;
+
+    /* Same mapping as trie_t.slot_of */
+    short slot_of[TRIE_BYTE_ALPHABET_SIZE];
+
+    /* LOUDS bits, number of 1s before each word, word of every 64th zero */
+    unsigned long long louds, louds_rank, louds_select;
+    /* Edge slots, one byte each */
+    unsigned long long labels;
+    /* 1 for nodes that hold a key, number of 1s before each word */
+    unsigned long long end, end_rank;
+    /* n_keys values of data_size bytes, in node order */
+    unsigned long long values;
+    unsigned long long file_size;
+};
+
+typedef struct frozen_trie_t frozen_trie_t;
+struct frozen_trie_t {
+    /* The image and its length; mapped is 1 if it comes from mmap */
+    unsigned char* base;
+    size_t length;
+    int mapped;
+
+    frozen_trie_header_t* header;
+    unsigned long long* louds;
+    unsigned int* louds_rank;
+    unsigned int* louds_select;
+    unsigned char* labels;
+    unsigned long long* end;
+    unsigned int* end_rank;
+    unsigned char* values;
+};
+
+frozen_trie_t* trie_freeze(trie_t* trie);
+void* frozen_trie_search(frozen_trie_t* ft, char* key);
+void* frozen_trie_search_len(frozen_trie_t* ft, const char* key, int len);
+int frozen_trie_get_size(frozen_trie_t* ft);
+int frozen_trie_save(frozen_trie_t* ft, const char* path);
+frozen_trie_t* frozen_trie_open_mmap(const char* path);
+void frozen_trie_free(frozen_trie_t** ft);
+
+#endif
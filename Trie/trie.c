@@ -1,14 +1,586 @@
+#include <unistd.h>
+
+#include "trie.h"
+
+/* Maximum number of children of each sparse layout */
+static const int trie_layout_capacity[] = {4, 16, 48};
+
+/* Slot of character c (-1 if c is not in the alphabet) and its inverse */
+#define __TRIE_SLOT(trie, c) ((trie)->slot_of[(unsigned char)(c)])
+#define __TRIE_CHAR(trie, slot) ((char)(trie)->char_of[slot])
+
+static void *__trie_arena_alloc(trie_t *trie, size_t size) {
+    trie_arena_t *arena = &trie->arena;
+    size_t units = (size + 7) / 8;
+    void *block;
+
+    if (units > TRIE_ARENA_CLASSES) {
+        trie_arena_large_t *large = malloc(sizeof(trie_arena_large_t) + size);
+        DIE(large == NULL, "trie arena large malloc");
+        large->prev = NULL;
+        large->next = arena->large;
+        if (arena->large)
+            arena->large->prev = large;
+        arena->large = large;
+        block = large + 1;
+    } else if (arena->free[units - 1]) {
+        block = arena->free[units - 1];
+        arena->free[units - 1] = *(void**)block;
+    } else {
+        if (arena->left < units * 8) {
+            void **chunk = malloc(TRIE_ARENA_CHUNK);
+            DIE(chunk == NULL, "trie arena chunk malloc");
+            *chunk = arena->chunks;
+            arena->chunks = chunk;
+            arena->bump = (char*)(chunk + 1);
+            arena->left = TRIE_ARENA_CHUNK - sizeof(void*);
+        }
+        block = arena->bump;
+        arena->bump += units * 8;
+        arena->left -= units * 8;
+    }
+
+    memset(block, 0, size);
+    return block;
+}
+
+static void __trie_arena_free(trie_t *trie, void *block, size_t size) {
+    trie_arena_t *arena = &trie->arena;
+    size_t units = (size + 7) / 8;
+
+    if (units > TRIE_ARENA_CLASSES) {
+        trie_arena_large_t *large = (trie_arena_large_t*)block - 1;
+        if (large->prev)
+            large->prev->next = large->next;
+        else
+            arena->large = large->next;
+        if (large->next)
+            large->next->prev = large->prev;
+        free(large);
+        return;
+    }
+
+    *(void**)block = arena->free[units - 1];
+    arena->free[units - 1] = block;
+}
+
+static void __trie_arena_destroy(trie_arena_t *arena) {
+    while (arena->chunks) {
+        void *next = *(void**)arena->chunks;
+        free(arena->chunks);
+        arena->chunks = next;
+    }
+    while (arena->large) {
+        trie_arena_large_t *next = arena->large->next;
+        free(arena->large);
+        arena->large = next;
+    }
+}
+
+/*
+ * Hands every block of src (chunks, released and large blocks) over to dst.
+ * The chunk with the most room left becomes the one dst cuts from.
+ */
+static void __trie_arena_merge(trie_arena_t *dst, trie_arena_t *src) {
+    if (src->chunks) {
+        void **tail = src->chunks;
+        while (*tail)
+            tail = *tail;
+
+        if (!dst->chunks || src->left > dst->left) {
+            *tail = dst->chunks;
+            dst->chunks = src->chunks;
+            dst->bump = src->bump;
+            dst->left = src->left;
+        } else {
+            *tail = *(void**)dst->chunks;
+            *(void**)dst->chunks = src->chunks;
+        }
+    }
+
+    for (int i = 0; i < TRIE_ARENA_CLASSES; i++) {
+        if (!src->free[i])
+            continue;
+        void **tail = src->free[i];
+        while (*tail)
+            tail = *tail;
+        *tail = dst->free[i];
+        dst->free[i] = src->free[i];
+    }
+
+    if (src->large) {
+        trie_arena_large_t *tail = src->large;
+        while (tail->next)
+            tail = tail->next;
+        tail->next = dst->large;
+        if (dst->large)
+            dst->large->prev = tail;
+        dst->large = src->large;
+    }
+    memset(src, 0, sizeof(trie_arena_t));
+}
+
+#define __TRIE_LOAD(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define __TRIE_PUBLISH(ptr, val) __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+
+/*
+ * Concurrent mode: defers the release of memory that readers may still reach
+ * (see __trie_try_reclaim). Called with the write lock held.
+ */
+static void __trie_retire(trie_t *trie, int kind, void *ptr) {
+    trie_retired_t *retired = malloc(sizeof(trie_retired_t));
+    DIE(retired == NULL, "trie retired malloc");
+
+    retired->kind = kind;
+    retired->ptr = ptr;
+    retired->next = trie->rcu->limbo[trie->rcu->epoch % 3];
+    trie->rcu->limbo[trie->rcu->epoch % 3] = retired;
+}
+
+/* Number of the pool chunk that holds index */
+static int __trie_pool_chunk(trie_index_t index) {
+    return 31 - __builtin_clz(index + TRIE_POOL_FIRST) - __builtin_ctz(TRIE_POOL_FIRST);
+}
+
+/*
+ * Hands out count consecutive fresh indices, allocating the chunks that hold
+ * them. The nodes are not initialised and nNodes is left to the caller.
+ */
+static trie_index_t __trie_pool_reserve(trie_t *trie, trie_index_t count) {
+    trie_index_t first = trie->pool_used;
+    unsigned long long limit = ((unsigned long long)TRIE_POOL_FIRST << TRIE_POOL_CHUNKS) - TRIE_POOL_FIRST;
+
+    DIE((unsigned long long)first + count > limit, "trie node pool full");
+    if (!count)
+        return first;
+
+    for (int chunk = __trie_pool_chunk(first); chunk <= __trie_pool_chunk(first + count - 1); chunk++) {
+        if (!trie->pool[chunk]) {
+            trie->pool[chunk] = malloc(((size_t)TRIE_POOL_FIRST << chunk) * sizeof(trie_node_t));
+            DIE(trie->pool[chunk] == NULL, "trie node pool malloc");
+        }
+    }
+    trie->pool_used += count;
+    return first;
+}
+
+/* Zeroes the node at index, which is not in use */
+static trie_node_t *__trie_pool_init(trie_t *trie, trie_index_t index) {
+    trie_node_t *node = trie_node_at(trie, index);
+
+    memset(node, 0, sizeof(trie_node_t));
+    node->index = index;
+    return node;
+}
+
+/* Takes a zeroed node from the pool (a released one, if any) */
+static trie_node_t *__trie_pool_alloc(trie_t *trie) {
+    trie_index_t index = trie->pool_free;
+
+    if (index)
+        trie->pool_free = trie_node_at(trie, index)->n_children;
+    else
+        index = __trie_pool_reserve(trie, 1);
+
+    trie->nNodes++;
+    return __trie_pool_init(trie, index);
+}
+
+/* Gives node back to the pool; its edges and label must be released already */
+static void __trie_pool_release(trie_t *trie, trie_node_t *node) {
+    trie_index_t index = node->index;
+
+    memset(node, 0, sizeof(trie_node_t));
+    node->n_children = trie->pool_free;
+    trie->pool_free = index;
+    trie->nNodes--;
+}
+
+static int __trie_capacity(trie_t *trie, unsigned char type) {
+    if (type == TRIE_NODE256)
+        return trie->alphabet_size;
+    return trie_layout_capacity[type];
+}
+
+static size_t __trie_edges_size(trie_t *trie, unsigned char type) {
+    int capacity = __trie_capacity(trie, type);
+    size_t size = sizeof(trie_edges_t) + capacity * sizeof(trie_index_t);
+
+    if (type == TRIE_NODE4 || type == TRIE_NODE16)
+        size += capacity;
+    else if (type == TRIE_NODE48)
+        size += trie->alphabet_size;
+    return size;
+}
+
+/* Slot bytes of a block: sorted keys (NODE4/16) or the index (NODE48) */
+static unsigned char *__trie_slots(trie_t *trie, trie_edges_t *edges) {
+    return (unsigned char*)(edges->children + __trie_capacity(trie, edges->type));
+}
+
+/* Smallest layout that holds n children */
+static unsigned char __trie_layout_for(trie_t *trie, int n) {
+    size_t full = __trie_edges_size(trie, TRIE_NODE256);
+
+    for (unsigned char type = TRIE_NODE4; type < TRIE_NODE256; type++) {
+        if (n <= trie_layout_capacity[type] && __trie_edges_size(trie, type) < full)
+            return type;
+    }
+    return TRIE_NODE256;
+}
+
+static trie_edges_t *__trie_edges_alloc(trie_t *trie, unsigned char type) {
+    trie_edges_t *edges = __trie_arena_alloc(trie, __trie_edges_size(trie, type));
+
+    edges->type = type;
+    return edges;
+}
+
+static void __trie_edges_free(trie_t *trie, trie_edges_t *edges) {
+    if (edges)
+        __trie_arena_free(trie, edges, __trie_edges_size(trie, edges->type));
+}
+
+/*
+ * Returns the child of node on the given slot, or NULL.
+ */
+trie_node_t* trie_node_child(trie_t* trie, trie_node_t* node, int slot) {
+    trie_edges_t *edges = __TRIE_LOAD(&node->edges);
+
+    if (!edges)
+        return NULL;
+
+    switch (edges->type) {
+    case TRIE_NODE4:
+    case TRIE_NODE16: {
+        unsigned char *keys = __trie_slots(trie, edges);
+        int capacity = __trie_capacity(trie, edges->type);
+        for (int i = 0; i < capacity && edges->children[i]; i++) {
+            if (keys[i] == slot)
+                return trie_node_at(trie, edges->children[i]);
+            if (keys[i] > slot)
+                return NULL;
+        }
+        return NULL;
+    }
+    case TRIE_NODE48: {
+        unsigned char position = __trie_slots(trie, edges)[slot];
+        return position ? trie_node_at(trie, edges->children[position - 1]) : NULL;
+    }
+    default:
+        return edges->children[slot] ? trie_node_at(trie, edges->children[slot]) : NULL;
+    }
+}
+
+/*
+ * Returns the first child of node whose slot is >= from (storing the slot in
+ * *slot), or NULL if there is none. Children come out in slot order, so
+ * walking with from = previous slot + 1 visits keys in alphabet order.
+ */
+trie_node_t* trie_node_next_child(trie_t* trie, trie_node_t* node, int from, int* slot) {
+    trie_edges_t *edges = __TRIE_LOAD(&node->edges);
+
+    if (!edges)
+        return NULL;
+
+    switch (edges->type) {
+    case TRIE_NODE4:
+    case TRIE_NODE16: {
+        unsigned char *keys = __trie_slots(trie, edges);
+        int capacity = __trie_capacity(trie, edges->type);
+        for (int i = 0; i < capacity && edges->children[i]; i++) {
+            if (keys[i] >= from) {
+                *slot = keys[i];
+                return trie_node_at(trie, edges->children[i]);
+            }
+        }
+        return NULL;
+    }
+    case TRIE_NODE48: {
+        unsigned char *index = __trie_slots(trie, edges);
+        for (int s = from; s < trie->alphabet_size; s++) {
+            if (index[s]) {
+                *slot = s;
+                return trie_node_at(trie, edges->children[index[s] - 1]);
+            }
+        }
+        return NULL;
+    }
+    default:
+        for (int s = from; s < trie->alphabet_size; s++) {
+            if (edges->children[s]) {
+                *slot = s;
+                return trie_node_at(trie, edges->children[s]);
+            }
+        }
+        return NULL;
+    }
+}
+
+/* Stores child on slot, which must be free and fit in the current layout */
+static void __trie_edges_put(trie_t *trie, trie_edges_t *edges, int n_children,
+                             int slot, trie_node_t *child) {
+    switch (edges->type) {
+    case TRIE_NODE4:
+    case TRIE_NODE16: {
+        unsigned char *keys = __trie_slots(trie, edges);
+        int i = n_children;
+        while (i > 0 && keys[i - 1] > slot) {
+            keys[i] = keys[i - 1];
+            edges->children[i] = edges->children[i - 1];
+            i--;
+        }
+        keys[i] = slot;
+        edges->children[i] = child->index;
+        break;
+    }
+    case TRIE_NODE48: {
+        int position = 0;
+        while (edges->children[position])
+            position++;
+        edges->children[position] = child->index;
+        __trie_slots(trie, edges)[slot] = position + 1;
+        break;
+    }
+    default:
+        edges->children[slot] = child->index;
+    }
+}
+
+/* Replaces the child already stored on slot */
+static void __trie_set_child(trie_t *trie, trie_node_t *node, int slot, trie_node_t *child) {
+    trie_edges_t *edges = node->edges;
+
+    switch (edges->type) {
+    case TRIE_NODE4:
+    case TRIE_NODE16: {
+        unsigned char *keys = __trie_slots(trie, edges);
+        int i = 0;
+        while (keys[i] != slot)
+            i++;
+        edges->children[i] = child->index;
+        break;
+    }
+    case TRIE_NODE48:
+        edges->children[__trie_slots(trie, edges)[slot] - 1] = child->index;
+        break;
+    default:
+        edges->children[slot] = child->index;
+    }
+}
+
+/*
+ * Installs edges as the children of node and disposes of the old block. In
+ * concurrent mode the new block is published with a release store (readers
+ * see it fully built) and the old one is retired, as readers may still walk
+ * it.
+ */
+static void __trie_edges_replace(trie_t *trie, trie_node_t *node, trie_edges_t *edges) {
+    trie_edges_t *old = node->edges;
+
+    if (old == edges)
+        return;
+
+    __TRIE_PUBLISH(&node->edges, edges);
+    if (old && trie->rcu)
+        __trie_retire(trie, TRIE_RETIRED_EDGES, old);
+    else
+        __trie_edges_free(trie, old);
+}
+
+/*
+ * Block of node that can be changed: node->edges itself or, in concurrent
+ * mode, where published blocks are never changed, a copy of it to be
+ * installed with __trie_edges_replace.
+ */
+static trie_edges_t *__trie_edges_writable(trie_t *trie, trie_node_t *node) {
+    if (!trie->rcu)
+        return node->edges;
+
+    size_t size = __trie_edges_size(trie, node->edges->type);
+    trie_edges_t *copy = __trie_arena_alloc(trie, size);
+    memcpy(copy, node->edges, size);
+    return copy;
+}
+
+/* Copies the children of node to a new block of the given layout */
+static trie_edges_t *__trie_edges_copy(trie_t *trie, trie_node_t *node, unsigned char type) {
+    trie_edges_t *edges = __trie_edges_alloc(trie, type);
+    trie_node_t *child;
+    int slot = -1, n = 0;
+
+    while ((child = trie_node_next_child(trie, node, slot + 1, &slot)) != NULL)
+        __trie_edges_put(trie, edges, n++, slot, child);
+    return edges;
+}
+
+static void __trie_add_child(trie_t *trie, trie_node_t *node, int slot, trie_node_t *child) {
+    trie_edges_t *edges;
+
+    if (!node->edges)
+        edges = __trie_edges_alloc(trie, __trie_layout_for(trie, 1));
+    else if (node->n_children == __trie_capacity(trie, node->edges->type))
+        edges = __trie_edges_copy(trie, node, __trie_layout_for(trie, node->n_children + 1));
+    else
+        edges = __trie_edges_writable(trie, node);
+
+    __trie_edges_put(trie, edges, node->n_children, slot, child);
+    __trie_edges_replace(trie, node, edges);
+    node->n_children++;
+}
+
+static void __trie_remove_child(trie_t *trie, trie_node_t *node, int slot) {
+    trie_edges_t *edges = __trie_edges_writable(trie, node);
+
+    switch (edges->type) {
+    case TRIE_NODE4:
+    case TRIE_NODE16: {
+        unsigned char *keys = __trie_slots(trie, edges);
+        int i = 0;
+        while (keys[i] != slot)
+            i++;
+        for (; i < node->n_children - 1; i++) {
+            keys[i] = keys[i + 1];
+            edges->children[i] = edges->children[i + 1];
+        }
+        edges->children[i] = 0;
+        break;
+    }
+    case TRIE_NODE48: {
+        unsigned char *index = __trie_slots(trie, edges);
+        edges->children[index[slot] - 1] = 0;
+        index[slot] = 0;
+        break;
+    }
+    default:
+        edges->children[slot] = 0;
+    }
+    node->n_children--;
+
+    if (node->n_children == 0) {
+        if (edges != node->edges)
+            __trie_edges_free(trie, edges);
+        __trie_edges_replace(trie, node, NULL);
+        return;
+    }
+
+    /* Shrink once the children would fit twice in a smaller layout */
+    __trie_edges_replace(trie, node, edges);
+    if (__trie_layout_for(trie, 2 * node->n_children) < edges->type)
+        __trie_edges_replace(trie, node,
+                             __trie_edges_copy(trie, node, __trie_layout_for(trie, 2 * node->n_children)));
+}
+
 trie_node_t* trie_create_node(trie_t *trie) {
-    trie_node_t *current = calloc(1, sizeof(trie_node_t));
-    DIE(current == NULL, "trie_node_t calloc");
+    return __trie_pool_alloc(trie);
+}
 
-    current->children = calloc(trie->alphabet_size, sizeof(trie_node_t*));
-    DIE(current->children == NULL, "trie_node_t->children calloc");
+static void __trie_set_label(trie_t *trie, trie_node_t *node, const char *label, int label_len) {
+    char *copy = NULL;
 
-    return current;
+    if (label_len) {
+        copy = __trie_arena_alloc(trie, label_len);
+        memcpy(copy, label, label_len);
+    }
+    if (node->label)
+        __trie_arena_free(trie, node->label, node->label_len);
+    node->label = copy;
+    node->label_len = label_len;
+}
+
+static void __trie_free_node(trie_t *trie, trie_node_t *trie_node) {
+    if (trie_node->label)
+        __trie_arena_free(trie, trie_node->label, trie_node->label_len);
+    __trie_edges_free(trie, trie_node->edges);
+    __trie_pool_release(trie, trie_node);
+}
+
+/*
+ * Radix mode: node sits on slot of parent and the key only matched the first
+ * `matched` characters of its label. Inserts a new node holding that common
+ * part between parent and node and returns it.
+ */
+static trie_node_t *__trie_split(trie_t *trie, trie_node_t *parent, int slot,
+                                 trie_node_t *node, int matched) {
+    trie_node_t *middle = trie_create_node(trie);
+
+    __trie_set_label(trie, middle, node->label, matched);
+    middle->max_score = node->max_score;
+    __trie_set_child(trie, parent, slot, middle);
+    __trie_add_child(trie, middle, __TRIE_SLOT(trie, node->label[matched]), node);
+    __trie_set_label(trie, node, node->label + matched + 1, node->label_len - matched - 1);
+    return middle;
 }
 
+/*
+ * Radix mode: merges a node that holds no value and has a single child with
+ * that child. The node keeps its place in the parent and takes over the
+ * child's value and children; its label becomes label + edge + child label.
+ */
+static void __trie_merge(trie_t *trie, trie_node_t *node) {
+    int slot;
+    trie_node_t *child = trie_node_next_child(trie, node, 0, &slot);
+    int label_len = node->label_len + 1 + child->label_len;
+    char *label = __trie_arena_alloc(trie, label_len);
+
+    if (node->label_len)
+        memcpy(label, node->label, node->label_len);
+    label[node->label_len] = __TRIE_CHAR(trie, slot);
+    if (child->label_len)
+        memcpy(label + node->label_len + 1, child->label, child->label_len);
+
+    if (node->label)
+        __trie_arena_free(trie, node->label, node->label_len);
+    __trie_edges_free(trie, node->edges);
+    node->label = label;
+    node->label_len = label_len;
+    node->value = child->value;
+    node->end_of_word = child->end_of_word;
+    node->edges = child->edges;
+    node->n_children = child->n_children;
+    node->max_score = child->max_score;
+
+    child->edges = NULL;
+    __trie_free_node(trie, child);
+}
+
+static void __trie_raise_score(trie_t *trie, trie_node_t *node, double score) {
+    if (trie->score_cb && score > node->max_score)
+        node->max_score = score;
+}
+
+/* Recomputes max_score of node from its value and its children */
+static void __trie_rescore(trie_t *trie, trie_node_t *node) {
+    trie_node_t *child;
+    int slot = -1;
+
+    node->max_score = node->end_of_word ? trie->score_cb(node->value) : -DBL_MAX;
+    while ((child = trie_node_next_child(trie, node, slot + 1, &slot)) != NULL) {
+        if (child->max_score > node->max_score)
+            node->max_score = child->max_score;
+    }
+}
+
+/* Recomputes max_score bottom-up along the path of key, which is in the trie */
+static void __trie_rescore_path(trie_t *trie, trie_node_t *node, const char *key, int len) {
+    if (len) {
+        trie_node_t *child = trie_node_child(trie, node, __TRIE_SLOT(trie, *key));
+        __trie_rescore_path(trie, child, key + 1 + child->label_len,
+                            len - 1 - child->label_len);
+    }
+    __trie_rescore(trie, node);
+}
+
+/*
+ * alphabet holds alphabet_size distinct characters; a character's position in
+ * it is the slot of its edge. With alphabet = NULL (and alphabet_size =
+ * TRIE_BYTE_ALPHABET_SIZE) every byte value is a valid character, which
+ * allows arbitrary binary keys through the *_len functions.
+ */
 trie_t* trie_create(int data_size, int alphabet_size, char* alphabet, void (*free_value_cb)(void*)) {
+    DIE(alphabet_size <= 0 || alphabet_size > TRIE_BYTE_ALPHABET_SIZE, "trie alphabet_size");
+    DIE(alphabet == NULL && alphabet_size != TRIE_BYTE_ALPHABET_SIZE, "trie byte alphabet_size");
+
     trie_t *current = calloc(1, sizeof(trie_t));
     DIE(current == NULL, "trie calloc");
 
@@ -16,94 +588,1007 @@ trie_t* trie_create(int data_size, int alphabet_size, char* alphabet, void (*fre
     current->alphabet_size = alphabet_size;
     current->alphabet = alphabet;
 
+    memset(current->slot_of, -1, sizeof(current->slot_of));
+    for (int slot = 0; slot < alphabet_size; slot++) {
+        unsigned char c = alphabet ? (unsigned char)alphabet[slot] : slot;
+        DIE(current->slot_of[c] != -1, "trie duplicate alphabet character");
+        current->slot_of[c] = slot;
+        current->char_of[slot] = c;
+    }
+
     current->free_value_cb = free_value_cb;
 
+    current->pool_used = 1;
     current->root = trie_create_node(current);
-    current->nNodes = 1;
     return current;
 }
 
-void trie_insert(trie_t* trie, char* key, void* value) {
+/*
+ * Switches an empty trie to concurrent mode: trie_search may then run in any
+ * number of registered reader threads, without locks, while trie_insert and
+ * trie_remove are called from other threads.
+ *
+ * Readers only use acquire loads. Writers are serialized by write_lock and
+ * never change an edge block once it is published: a new child means a new
+ * block, installed with a single release store, and values are published the
+ * same way. Blocks, values and nodes unlinked by writers are freed through
+ * epoch-based reclamation, once no reader can still hold them, so nNodes may
+ * briefly count removed nodes. Radix mode is not supported (labels are
+ * changed in place); prefix iteration and top-k queries are not lock-free and
+ * must not overlap with writers.
+ */
+void trie_enable_concurrent(trie_t* trie) {
+    DIE(trie->nNodes != 1, "trie_enable_concurrent on a non-empty trie");
+    DIE(trie->radix, "trie_enable_concurrent on a radix trie");
+
+    if (trie->rcu != NULL)
+        return;
+
+    trie->rcu = aligned_alloc(64, sizeof(trie_rcu_t));
+    DIE(trie->rcu == NULL, "trie_rcu_t aligned_alloc");
+    memset(trie->rcu, 0, sizeof(trie_rcu_t));
+    DIE(pthread_mutex_init(&trie->rcu->write_lock, NULL) != 0, "trie pthread_mutex_init");
+}
+
+/*
+ * Registers a reader thread and returns its id, to be passed to
+ * trie_read_lock / trie_read_unlock.
+ */
+unsigned int trie_register_reader(trie_t* trie) {
+    pthread_mutex_lock(&trie->rcu->write_lock);
+    DIE(trie->rcu->n_readers == TRIE_MAX_READERS, "trie too many readers");
+    unsigned int id = trie->rcu->n_readers++;
+    pthread_mutex_unlock(&trie->rcu->write_lock);
+
+    return id;
+}
+
+/*
+ * Enters a read section by announcing the current epoch. The fence makes the
+ * announcement visible to writers before any node is loaded.
+ */
+void trie_read_lock(trie_t* trie, unsigned int reader) {
+    unsigned long epoch = __atomic_load_n(&trie->rcu->epoch, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&trie->rcu->readers[reader].epoch, (epoch << 1) | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void trie_read_unlock(trie_t* trie, unsigned int reader) {
+    __atomic_store_n(&trie->rcu->readers[reader].epoch, 0, __ATOMIC_RELEASE);
+}
+
+static void __trie_release_retired(trie_t *trie, trie_retired_t *retired, int teardown) {
+    while (retired != NULL) {
+        trie_retired_t *next = retired->next;
+        /* On teardown, the pool and the arena go away as a whole */
+        if (retired->kind == TRIE_RETIRED_VALUE)
+            trie->free_value_cb(retired->ptr);
+        else if (!teardown && retired->kind == TRIE_RETIRED_EDGES)
+            __trie_edges_free(trie, retired->ptr);
+        else if (!teardown)
+            __trie_free_node(trie, retired->ptr);
+        free(retired);
+        retired = next;
+    }
+}
+
+/*
+ * Advances the global epoch if every active reader has announced the current
+ * one, then frees what was retired two epochs ago: every reader that could
+ * have seen it has left its read section since. Called with the write lock
+ * held.
+ */
+static void __trie_try_reclaim(trie_t *trie) {
+    trie_rcu_t *rcu = trie->rcu;
+    unsigned long epoch = rcu->epoch;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (unsigned int i = 0; i < rcu->n_readers; i++) {
+        unsigned long announced = __atomic_load_n(&rcu->readers[i].epoch, __ATOMIC_ACQUIRE);
+        if ((announced & 1) && (announced >> 1) != epoch)
+            return;
+    }
+
+    epoch++;
+    __atomic_store_n(&rcu->epoch, epoch, __ATOMIC_RELEASE);
+
+    /* What was retired in epoch - 2 is in limbo[(epoch + 1) % 3] */
+    trie_retired_t *retired = rcu->limbo[(epoch + 1) % 3];
+    rcu->limbo[(epoch + 1) % 3] = NULL;
+    __trie_release_retired(trie, retired, 0);
+}
+
+/*
+ * Switches an empty trie to radix (path-compressed) mode: a chain of nodes
+ * with a single child and no value is stored as one node, whose label holds
+ * the skipped characters. Edges are split on insert and merged back on
+ * remove, so the trie never contains such chains.
+ */
+void trie_enable_radix(trie_t* trie) {
+    DIE(trie->nNodes != 1, "trie_enable_radix on a non-empty trie");
+    DIE(trie->rcu != NULL, "trie_enable_radix on a concurrent trie");
+
+    trie->radix = 1;
+}
+
+static void __trie_insert(trie_t *trie, const char *key, int len, void *value) {
+    double score = trie->score_cb ? trie->score_cb(value) : 0;
+    const char *start = key, *end = key + len;
     trie_node_t *iterator = trie->root;
-    while (*key) {
-        if (!iterator->children[*key - 'a']) {
-            iterator->children[*key- 'a'] = trie_create_node(trie);
-            iterator->n_children++;
-            trie->nNodes++;
+    __trie_raise_score(trie, iterator, score);
+    while (key < end) {
+        int slot = __TRIE_SLOT(trie, *key);
+        trie_node_t *child = trie_node_child(trie, iterator, slot);
+        key++;
+        if (!child) {
+            child = trie_create_node(trie);
+            child->max_score = score;
+            __trie_add_child(trie, iterator, slot, child);
+            if (trie->radix) {
+                __trie_set_label(trie, child, key, end - key);
+                key = end;
+            }
+        } else if (child->label_len) {
+            int matched = 0;
+            while (matched < child->label_len && key + matched < end &&
+                   key[matched] == child->label[matched])
+                matched++;
+            if (matched < child->label_len)
+                child = __trie_split(trie, iterator, slot, child, matched);
+            key += matched;
         }
-        iterator = iterator->children[*key - 'a'];
+        __trie_raise_score(trie, child, score);
+        iterator = child;
+    }
+
+    void *copy = calloc(1, trie->data_size);
+    DIE(copy == NULL, "trie value calloc");
+    memcpy(copy, value, trie->data_size);
+
+    /* An overwritten value may have been the best of its subtrees */
+    int rescore = 0;
+    if (iterator->end_of_word) {
+        void *old = iterator->value;
+        rescore = trie->score_cb && trie->score_cb(old) > score;
+        __TRIE_PUBLISH(&iterator->value, copy);
+        if (trie->rcu)
+            __trie_retire(trie, TRIE_RETIRED_VALUE, old);
+        else
+            trie->free_value_cb(old);
+    } else {
+        trie->size++;
+        __TRIE_PUBLISH(&iterator->value, copy);
+        __TRIE_PUBLISH(&iterator->end_of_word, 1);
+    }
+
+    if (rescore)
+        __trie_rescore_path(trie, trie->root, start, len);
+}
+
+/*
+ * Inserts the len characters of key. Returns 0 on success or -1 (leaving the
+ * trie unchanged) if key has a character outside the alphabet.
+ */
+int trie_insert_len(trie_t* trie, const char* key, int len, void* value) {
+    for (int i = 0; i < len; i++) {
+        if (__TRIE_SLOT(trie, key[i]) < 0)
+            return -1;
+    }
+
+    if (trie->rcu)
+        pthread_mutex_lock(&trie->rcu->write_lock);
+    __trie_insert(trie, key, len, value);
+    if (trie->rcu) {
+        __trie_try_reclaim(trie);
+        pthread_mutex_unlock(&trie->rcu->write_lock);
+    }
+    return 0;
+}
+
+int trie_insert(trie_t* trie, char* key, void* value) {
+    return trie_insert_len(trie, key, strlen(key), value);
+}
+
+/* Keys of a bulk build that start with the same character */
+typedef struct {
+    int lo, hi;
+    /* First of the count pool indices reserved for the subtrie */
+    trie_index_t first, count;
+    trie_node_t *node;
+} trie_build_group_t;
+
+typedef struct {
+    char **keys;
+    int *lens;
+    unsigned char *values;
+    /* Length of the prefix each key shares with the one before it */
+    int *common;
+    int max_len;
+    trie_build_group_t *groups;
+    int n_groups;
+    /* Next group to be built */
+    int next;
+} trie_build_t;
+
+/* Child of a node under construction, not yet in its edges */
+typedef struct {
+    int slot;
+    trie_node_t *node;
+} trie_build_child_t;
+
+/*
+ * A builder thread: works on a copy of the trie that shares its pool but has
+ * an arena of its own, so that it never needs a lock.
+ */
+typedef struct {
+    trie_build_t *build;
+    trie_t shadow;
+    pthread_t thread;
+
+    /* path[d]: node of the first d characters of the previous key */
+    trie_node_t **path;
+    /* Children found so far for path[d]: n_children[d] of them, from
+     * children + d * alphabet_size */
+    trie_build_child_t *children;
+    int *n_children;
+} trie_builder_t;
+
+static int __trie_common_prefix(const char *a, int a_len, const char *b, int b_len) {
+    int n = a_len < b_len ? a_len : b_len, i = 0;
+
+    while (i < n && a[i] == b[i])
+        i++;
+    return i;
+}
+
+/* path[depth] is complete: gives it its edges, in the smallest layout */
+static void __trie_build_close(trie_t *trie, trie_builder_t *builder, int depth) {
+    trie_build_child_t *children = builder->children + (size_t)depth * trie->alphabet_size;
+    int n = builder->n_children[depth];
+
+    if (!n)
+        return;
+
+    trie_edges_t *edges = __trie_edges_alloc(trie, __trie_layout_for(trie, n));
+    for (int i = 0; i < n; i++)
+        __trie_edges_put(trie, edges, i, children[i].slot, children[i].node);
+    builder->path[depth]->edges = edges;
+    builder->path[depth]->n_children = n;
+    builder->n_children[depth] = 0;
+}
+
+/*
+ * Builds the subtrie of a group out of its reserved nodes. Each key only walks
+ * down from where it leaves the previous one; the nodes below that point are
+ * complete, so their edges are allocated once, with all their children.
+ */
+static void __trie_build_group(trie_t *trie, trie_builder_t *builder, trie_build_group_t *group) {
+    trie_build_t *build = builder->build;
+    trie_node_t **path = builder->path;
+    trie_index_t index = group->first;
+    int prev_len = 0;
+
+    for (int i = group->lo; i < group->hi; i++) {
+        const char *key = build->keys[i];
+        int len = build->lens[i];
+        void *value = build->values + (size_t)i * trie->data_size;
+        double score = trie->score_cb ? trie->score_cb(value) : 0;
+        int depth = i > group->lo ? build->common[i] : 0;
+
+        for (int d = prev_len; d > depth; d--)
+            __trie_build_close(trie, builder, d);
+        for (int d = 1; d <= depth; d++)
+            __trie_raise_score(trie, path[d], score);
+
+        for (; depth < len; depth++) {
+            trie_node_t *child = __trie_pool_init(trie, index++);
+            child->max_score = score;
+            if (depth) {
+                int n = builder->n_children[depth]++;
+                builder->children[(size_t)depth * trie->alphabet_size + n] =
+                    (trie_build_child_t){__TRIE_SLOT(trie, key[depth]), child};
+            } else {
+                group->node = child;
+            }
+            path[depth + 1] = child;
+        }
+
+        trie_node_t *node = path[len];
+        node->value = calloc(1, trie->data_size);
+        DIE(node->value == NULL, "trie value calloc");
+        memcpy(node->value, value, trie->data_size);
+        node->end_of_word = 1;
+        prev_len = len;
+    }
+
+    for (int d = prev_len; d > 0; d--)
+        __trie_build_close(trie, builder, d);
+}
+
+static void *__trie_builder_run(void *arg) {
+    trie_builder_t *builder = arg;
+    trie_build_t *build = builder->build;
+    size_t depths = build->max_len + 1;
+
+    builder->path = malloc(depths * sizeof(trie_node_t*));
+    DIE(builder->path == NULL, "trie build path malloc");
+    builder->children = malloc(depths * builder->shadow.alphabet_size * sizeof(trie_build_child_t));
+    DIE(builder->children == NULL, "trie build children malloc");
+    builder->n_children = calloc(depths, sizeof(int));
+    DIE(builder->n_children == NULL, "trie build children calloc");
+
+    int g;
+    while ((g = __atomic_fetch_add(&build->next, 1, __ATOMIC_RELAXED)) < build->n_groups)
+        __trie_build_group(&builder->shadow, builder, &build->groups[g]);
+
+    free(builder->path);
+    free(builder->children);
+    free(builder->n_children);
+    return NULL;
+}
+
+/*
+ * Fills an empty trie with n keys (of lens[i] characters) sorted in increasing
+ * byte order, without duplicates; values holds their n values, data_size bytes
+ * each. Consecutive keys share the nodes of their common prefix, so no key is
+ * walked from the root; the nodes are taken from the pool in one block and
+ * each one gets its edges once, in their final layout.
+ * Big inputs are split by first character into subtries built by up to
+ * TRIE_BUILD_THREADS threads. Radix and concurrent tries fall back to inserts.
+ * Returns 0 on success or -1 (leaving the trie unchanged) if the trie is not
+ * empty or the keys are not valid.
+ */
+int trie_build_sorted_len(trie_t* trie, char** keys, int* lens, void* values, int n) {
+    if (trie->size != 0 || trie->root->n_children != 0)
+        return -1;
+
+    trie_build_t build = {keys, lens, values, NULL, 0, NULL, 0, 0};
+    trie_build_group_t groups[TRIE_BYTE_ALPHABET_SIZE];
+    trie_index_t total = 0;
+
+    build.common = malloc((n ? n : 1) * sizeof(int));
+    DIE(build.common == NULL, "trie build common malloc");
+
+    for (int i = 0; i < n; i++) {
+        int common = 0;
+        if (i > 0) {
+            common = __trie_common_prefix(keys[i - 1], lens[i - 1], keys[i], lens[i]);
+            if (common == lens[i] ||
+                (common < lens[i - 1] && (unsigned char)keys[i - 1][common] > (unsigned char)keys[i][common]))
+                goto invalid;
+        }
+        /* The common prefix was checked with the previous key */
+        for (int j = common; j < lens[i]; j++) {
+            if (__TRIE_SLOT(trie, keys[i][j]) < 0)
+                goto invalid;
+        }
+
+        build.common[i] = common;
+        if (lens[i] > build.max_len)
+            build.max_len = lens[i];
+        if (!lens[i])
+            continue;
+
+        /* A new first character starts a new group */
+        if (!common)
+            groups[build.n_groups++] = (trie_build_group_t){i, i, 0, 0, NULL};
+        trie_build_group_t *group = &groups[build.n_groups - 1];
+        group->hi = i + 1;
+        group->count += lens[i] - common;
+        total += lens[i] - common;
+    }
+
+    if (trie->radix || trie->rcu) {
+        for (int i = 0; i < n; i++)
+            trie_insert_len(trie, keys[i], lens[i], (unsigned char*)values + (size_t)i * trie->data_size);
+        free(build.common);
+        return 0;
+    }
+
+    build.groups = groups;
+    for (int g = 0; g < build.n_groups; g++)
+        groups[g].first = __trie_pool_reserve(trie, groups[g].count);
+    trie->nNodes += total;
+
+    int n_threads = 1;
+    if (n >= TRIE_BUILD_PARALLEL_MIN) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = cpus < TRIE_BUILD_THREADS ? (cpus > 1 ? cpus : 1) : TRIE_BUILD_THREADS;
+        if (n_threads > build.n_groups)
+            n_threads = build.n_groups ? build.n_groups : 1;
+    }
+
+    trie_builder_t *builders = malloc(n_threads * sizeof(trie_builder_t));
+    DIE(builders == NULL, "trie builders malloc");
+    for (int t = 0; t < n_threads; t++) {
+        builders[t].build = &build;
+        builders[t].shadow = *trie;
+        memset(&builders[t].shadow.arena, 0, sizeof(trie_arena_t));
+    }
+
+    for (int t = 1; t < n_threads; t++)
+        DIE(pthread_create(&builders[t].thread, NULL, __trie_builder_run, &builders[t]) != 0,
+            "trie builder pthread_create");
+    __trie_builder_run(&builders[0]);
+    for (int t = 1; t < n_threads; t++)
+        pthread_join(builders[t].thread, NULL);
+
+    for (int t = 0; t < n_threads; t++)
+        __trie_arena_merge(&trie->arena, &builders[t].shadow.arena);
+    free(builders);
+
+    /* The subtries are hooked to the root only now, one thread at a time */
+    for (int g = 0; g < build.n_groups; g++)
+        __trie_add_child(trie, trie->root, __TRIE_SLOT(trie, keys[groups[g].lo][0]), groups[g].node);
+
+    if (n > 0 && lens[0] == 0) {
+        trie->root->value = calloc(1, trie->data_size);
+        DIE(trie->root->value == NULL, "trie value calloc");
+        memcpy(trie->root->value, values, trie->data_size);
+        trie->root->end_of_word = 1;
+    }
+    trie->size = n;
+    if (trie->score_cb)
+        __trie_rescore(trie, trie->root);
+    free(build.common);
+    return 0;
+
+invalid:
+    free(build.common);
+    return -1;
+}
+
+int trie_build_sorted(trie_t* trie, char** keys, void* values, int n) {
+    int *lens = malloc((n ? n : 1) * sizeof(int));
+    DIE(lens == NULL, "trie build lens malloc");
+
+    for (int i = 0; i < n; i++)
+        lens[i] = strlen(keys[i]);
+    int rc = trie_build_sorted_len(trie, keys, lens, values, n);
+    free(lens);
+    return rc;
+}
+
+/*
+ * In concurrent mode, trie_search runs without locks but must be called
+ * between trie_read_lock and trie_read_unlock; the value it returns stays
+ * valid only until trie_read_unlock and must not be changed.
+ */
+void* trie_search_len(trie_t* trie, const char* key, int len) {
+    trie_node_t *iterator = trie->root;
+    const char *end = key + len;
+    while (key < end) {
+        int slot = __TRIE_SLOT(trie, *key);
+        if (slot < 0)
+            return NULL;
+        iterator = trie_node_child(trie, iterator, slot);
+        if (!iterator)
+            return NULL;
         key++;
+        if (iterator->label_len) {
+            if (end - key < iterator->label_len ||
+                memcmp(key, iterator->label, iterator->label_len))
+                return NULL;
+            key += iterator->label_len;
+        }
     }
-    iterator->value = calloc(1, trie->data_size);
-    memcpy(iterator->value, value, trie->data_size);
-    iterator->end_of_word = 1;
+    if (__TRIE_LOAD(&iterator->end_of_word) == 0) return NULL;
+    return __TRIE_LOAD(&iterator->value);
 }
 
 void* trie_search(trie_t* trie, char* key) {
+    return trie_search_len(trie, key, strlen(key));
+}
+
+/*
+ * Removes key from the subtree of trie_node. Sets *removed if the key was
+ * found and returns 1 if trie_node itself is no longer needed (no value and
+ * no children), in which case the parent unlinks and frees it. In radix mode,
+ * a node left with no value and a single child is merged with that child.
+ * Scores are recomputed on the way back up.
+ */
+static int __trie_remove(trie_node_t *trie_node, trie_t *trie, const char *key, int len,
+                         int *removed) {
+    if (!len) {
+        if (trie_node->end_of_word == 0)
+            return 0;
+        void *old = trie_node->value;
+        __TRIE_PUBLISH(&trie_node->end_of_word, 0);
+        __TRIE_PUBLISH(&trie_node->value, NULL);
+        if (trie->rcu)
+            __trie_retire(trie, TRIE_RETIRED_VALUE, old);
+        else
+            trie->free_value_cb(old);
+        *removed = 1;
+    } else {
+        int slot = __TRIE_SLOT(trie, *key);
+        if (slot < 0)
+            return 0;
+        trie_node_t *child = trie_node_child(trie, trie_node, slot);
+        if (!child)
+            return 0;
+        if (child->label_len && (len - 1 < child->label_len ||
+                                 memcmp(key + 1, child->label, child->label_len)))
+            return 0;
+        int unlink = __trie_remove(child, trie, key + 1 + child->label_len,
+                                   len - 1 - child->label_len, removed);
+        if (!*removed)
+            return 0;
+
+        if (unlink) {
+            __trie_remove_child(trie, trie_node, slot);
+            if (trie->rcu)
+                __trie_retire(trie, TRIE_RETIRED_NODE, child);
+            else
+                __trie_free_node(trie, child);
+        }
+    }
+
+    if (trie_node->end_of_word == 0 && trie_node->n_children == 0)
+        return 1;
+    if (trie->radix && trie_node != trie->root &&
+        trie_node->end_of_word == 0 && trie_node->n_children == 1)
+        __trie_merge(trie, trie_node);
+    else if (trie->score_cb)
+        __trie_rescore(trie, trie_node);
+    return 0;
+}
+
+/*
+ * Returns 1 if key was in the trie (and is now removed), 0 otherwise.
+ */
+int trie_remove_len(trie_t* trie, const char* key, int len) {
+    int removed = 0;
+
+    if (trie->rcu)
+        pthread_mutex_lock(&trie->rcu->write_lock);
+    __trie_remove(trie->root, trie, key, len, &removed);
+    trie->size -= removed;
+    if (trie->rcu) {
+        __trie_try_reclaim(trie);
+        pthread_mutex_unlock(&trie->rcu->write_lock);
+    }
+    return removed;
+}
+
+int trie_remove(trie_t* trie, char* key) {
+    return trie_remove_len(trie, key, strlen(key));
+}
+
+/* Makes room for need characters in a growable key buffer */
+static void __trie_key_reserve(char **key, int *key_cap, int need) {
+    if (need <= *key_cap)
+        return;
+
+    int cap = *key_cap ? *key_cap : 16;
+    while (cap < need)
+        cap *= 2;
+    *key = realloc(*key, cap);
+    DIE(*key == NULL, "trie key realloc");
+    *key_cap = cap;
+}
+
+/* Writes the edge character and the label of child to key + at */
+static int __trie_key_put_edge(trie_t *trie, char **key, int *key_cap, int at,
+                               int slot, trie_node_t *child) {
+    __trie_key_reserve(key, key_cap, at + 1 + child->label_len);
+    (*key)[at] = __TRIE_CHAR(trie, slot);
+    if (child->label_len)
+        memcpy(*key + at + 1, child->label, child->label_len);
+    return at + 1 + child->label_len;
+}
+
+/*
+ * Returns the node whose subtree holds exactly the keys starting with prefix
+ * (in radix mode, prefix may end inside its label), or NULL if there is no
+ * such key. The key of the returned node is written to *key.
+ */
+static trie_node_t *__trie_find_prefix(trie_t *trie, const char *prefix, int len,
+                                       char **key, int *key_len, int *key_cap) {
     trie_node_t *iterator = trie->root;
-    while (*key) {
-        if (iterator->children[*key - 'a']) {
-            iterator = iterator->children[*key - 'a'];
-            key++;
-        } else {
+    int matched = 0;
+
+    *key_len = 0;
+    while (matched < len) {
+        int slot = __TRIE_SLOT(trie, prefix[matched]);
+        if (slot < 0)
+            return NULL;
+        iterator = trie_node_child(trie, iterator, slot);
+        if (!iterator)
+            return NULL;
+        matched++;
+
+        int check = iterator->label_len < len - matched ? iterator->label_len : len - matched;
+        if (check && memcmp(prefix + matched, iterator->label, check))
             return NULL;
+        matched += check;
+        *key_len = __trie_key_put_edge(trie, key, key_cap, *key_len, slot, iterator);
+    }
+    return iterator;
+}
+
+/*
+ * Starts an iteration over the keys that begin with the len characters of
+ * prefix, in alphabet order (a key comes before its extensions). The trie
+ * must not be modified until trie_iter_free.
+ */
+void trie_prefix_iter(trie_t* trie, const char* prefix, int len, trie_iter_t* it) {
+    memset(it, 0, sizeof(*it));
+    it->trie = trie;
+    it->top = -1;
+
+    trie_node_t *start = __trie_find_prefix(trie, prefix, len, &it->key,
+                                            &it->key_len, &it->key_cap);
+    if (!start)
+        return;
+
+    it->stack_cap = 16;
+    it->stack = malloc(it->stack_cap * sizeof(trie_iter_frame_t));
+    DIE(it->stack == NULL, "trie_iter_t stack malloc");
+    it->stack[0] = (trie_iter_frame_t){start, -2, it->key_len};
+    it->top = 0;
+}
+
+/*
+ * Returns the next node holding a key (its value is node->value, its key is
+ * it->key / it->key_len), or NULL once every key was returned.
+ */
+trie_node_t* trie_iter_next(trie_iter_t* it) {
+    while (it->top >= 0) {
+        trie_iter_frame_t *frame = &it->stack[it->top];
+
+        if (frame->slot == -2) {
+            frame->slot = -1;
+            if (frame->node->end_of_word) {
+                it->key_len = frame->depth;
+                return frame->node;
+            }
+        }
+
+        int slot;
+        trie_node_t *child = trie_node_next_child(it->trie, frame->node, frame->slot + 1, &slot);
+        if (!child) {
+            it->top--;
+            continue;
         }
+        frame->slot = slot;
+
+        int depth = __trie_key_put_edge(it->trie, &it->key, &it->key_cap,
+                                        frame->depth, slot, child);
+        if (it->top + 1 == it->stack_cap) {
+            it->stack_cap *= 2;
+            it->stack = realloc(it->stack, it->stack_cap * sizeof(trie_iter_frame_t));
+            DIE(it->stack == NULL, "trie_iter_t stack realloc");
+        }
+        it->stack[++it->top] = (trie_iter_frame_t){child, -2, depth};
     }
-    if (iterator->end_of_word == 0) return NULL;
-    return iterator->value;
+    return NULL;
 }
 
-int __trie_remove(trie_node_t *trie_node, trie_t *trie, char *key) {
-    if (!*key) {
-        if (trie_node->end_of_word == 1) {
-            if (trie_node->n_children) {
-                trie_node->end_of_word = 0;
-                return 0;
-            } else {
-                trie->free_value_cb(trie_node->value);
-                free(trie_node->children);
-                free(trie_node);
-                trie->nNodes--;
-                return 1;
+void trie_iter_free(trie_iter_t* it) {
+    free(it->stack);
+    free(it->key);
+    it->stack = NULL;
+    it->key = NULL;
+    it->top = -1;
+}
+
+/*
+ * Makes trie_top_k rank values by score_cb(value). Every node then keeps the
+ * best score found in its subtree, updated by trie_insert and trie_remove
+ * along the path of the key. Must be called on an empty trie.
+ */
+void trie_set_score(trie_t* trie, double (*score_cb)(void*)) {
+    DIE(trie->size != 0, "trie_set_score on a non-empty trie");
+
+    trie->score_cb = score_cb;
+    trie->root->max_score = -DBL_MAX;
+}
+
+/*
+ * Best-first search state of trie_top_k: a node reached from the node of
+ * entry parent through slot, and a max-heap of entries to expand (or, for
+ * terminal items, of values to report).
+ */
+typedef struct {
+    trie_node_t *node;
+    int parent, slot;
+} trie_topk_entry_t;
+
+typedef struct {
+    double score;
+    int entry, terminal;
+} trie_topk_item_t;
+
+static void __trie_heap_push(trie_topk_item_t **heap, int *n, int *cap, trie_topk_item_t item) {
+    if (*n == *cap) {
+        *cap = *cap ? *cap * 2 : 64;
+        *heap = realloc(*heap, *cap * sizeof(trie_topk_item_t));
+        DIE(*heap == NULL, "trie top-k heap realloc");
+    }
+
+    int i = (*n)++;
+    while (i > 0 && (*heap)[(i - 1) / 2].score < item.score) {
+        (*heap)[i] = (*heap)[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    (*heap)[i] = item;
+}
+
+static trie_topk_item_t __trie_heap_pop(trie_topk_item_t *heap, int *n) {
+    trie_topk_item_t top = heap[0], last = heap[--*n];
+    int i = 0;
+
+    while (2 * i + 1 < *n) {
+        int child = 2 * i + 1;
+        if (child + 1 < *n && heap[child + 1].score > heap[child].score)
+            child++;
+        if (heap[child].score <= last.score)
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (*n)
+        heap[i] = last;
+    return top;
+}
+
+/*
+ * Calls cb for the (at most) k keys starting with prefix that have the best
+ * scores, best first, and returns how many were reported. Subtrees are
+ * expanded in order of their max_score, so the work depends on k and on the
+ * fan-out along the way, not on the size of the subtree under prefix.
+ * Requires trie_set_score.
+ */
+int trie_top_k(trie_t* trie, const char* prefix, int len, int k,
+               void (*cb)(const char* key, int key_len, void* value, void* arg), void* arg) {
+    DIE(trie->score_cb == NULL, "trie_top_k without trie_set_score");
+
+    char *key = NULL;
+    int key_len = 0, key_cap = 0, reported = 0;
+    trie_node_t *start = __trie_find_prefix(trie, prefix, len, &key, &key_len, &key_cap);
+    if (!start || k <= 0) {
+        free(key);
+        return 0;
+    }
+
+    trie_topk_entry_t *entries = malloc(16 * sizeof(trie_topk_entry_t));
+    DIE(entries == NULL, "trie top-k entries malloc");
+    int n_entries = 1, entries_cap = 16;
+    trie_topk_item_t *heap = NULL;
+    int heap_size = 0, heap_cap = 0;
+    int *path = NULL, path_cap = 0;
+    int prefix_len = key_len;
+
+    entries[0] = (trie_topk_entry_t){start, -1, 0};
+    __trie_heap_push(&heap, &heap_size, &heap_cap, (trie_topk_item_t){start->max_score, 0, 0});
+
+    while (heap_size && reported < k) {
+        trie_topk_item_t item = __trie_heap_pop(heap, &heap_size);
+        trie_node_t *node = entries[item.entry].node;
+
+        if (item.terminal) {
+            /* Rebuild the key from the chain of parents */
+            int depth = 0;
+            for (int e = item.entry; e > 0; e = entries[e].parent) {
+                if (depth == path_cap) {
+                    path_cap = path_cap ? path_cap * 2 : 16;
+                    path = realloc(path, path_cap * sizeof(int));
+                    DIE(path == NULL, "trie top-k path realloc");
+                }
+                path[depth++] = e;
             }
-        } else return 0;
-    } else {
-        int test = 0;
-        if (trie_node->children[*key - 'a']) {
-            test = __trie_remove(trie_node->children[*key - 'a'], trie, key + 1);
+            key_len = prefix_len;
+            while (depth--) {
+                trie_topk_entry_t *e = &entries[path[depth]];
+                key_len = __trie_key_put_edge(trie, &key, &key_cap, key_len, e->slot, e->node);
+            }
+            cb(key, key_len, node->value, arg);
+            reported++;
+            continue;
         }
-        if (test) {
-            trie_node->children[*key - 'a'] = NULL;
-            trie_node->n_children--;
-            if (trie_node->n_children == 0) {
-                free(trie_node->children);
-                free(trie_node);
-                trie->nNodes--;
-                return 1;
-            } else return 0;
-        } else return 0;
+
+        if (node->end_of_word)
+            __trie_heap_push(&heap, &heap_size, &heap_cap,
+                             (trie_topk_item_t){trie->score_cb(node->value), item.entry, 1});
+
+        trie_node_t *child;
+        int slot = -1;
+        while ((child = trie_node_next_child(trie, node, slot + 1, &slot)) != NULL) {
+            if (n_entries == entries_cap) {
+                entries_cap *= 2;
+                entries = realloc(entries, entries_cap * sizeof(trie_topk_entry_t));
+                DIE(entries == NULL, "trie top-k entries realloc");
+            }
+            entries[n_entries] = (trie_topk_entry_t){child, item.entry, slot};
+            __trie_heap_push(&heap, &heap_size, &heap_cap,
+                             (trie_topk_item_t){child->max_score, n_entries, 0});
+            n_entries++;
+        }
+    }
+
+    free(key);
+    free(entries);
+    free(heap);
+    free(path);
+    return reported;
+}
+
+/*
+ * State of trie_fuzzy_search / trie_wildcard_search: a DFS that carries one
+ * row per character of the current key. Row d (at rows + d * (len + 1)) has,
+ * for every prefix of the query, its cost against the first d characters of
+ * the key; a subtree is skipped as soon as no entry of its row is <= limit.
+ */
+typedef struct trie_match_t trie_match_t;
+struct trie_match_t {
+    trie_t *trie;
+    const char *query;
+    int len, limit;
+    /* Computes row next from row prev and character c; returns its minimum */
+    int (*step)(trie_match_t *m, const int *prev, int *next, char c);
+
+    int *rows;
+    int rows_cap;
+    char *key;
+    int key_cap;
+
+    void (*fuzzy_cb)(const char *key, int key_len, void *value, int dist, void *arg);
+    void (*match_cb)(const char *key, int key_len, void *value, void *arg);
+    void *arg;
+    int found;
+};
+
+/* Levenshtein distance: insertions, deletions and substitutions cost 1 */
+static int __trie_fuzzy_step(trie_match_t *m, const int *prev, int *next, char c) {
+    int min = next[0] = prev[0] + 1;
+
+    for (int j = 1; j <= m->len; j++) {
+        int cost = prev[j - 1] + (m->query[j - 1] != c);
+        if (prev[j] + 1 < cost)
+            cost = prev[j] + 1;
+        if (next[j - 1] + 1 < cost)
+            cost = next[j - 1] + 1;
+        next[j] = cost;
+        if (cost < min)
+            min = cost;
     }
+    return min;
 }
 
-void trie_remove(trie_t* trie, char* key) {
-    __trie_remove(trie->root, trie, key);
+/* 0 if the pattern prefix matches the key so far, 1 otherwise */
+static int __trie_wildcard_step(trie_match_t *m, const int *prev, int *next, char c) {
+    int min = next[0] = 1;
+
+    for (int j = 1; j <= m->len; j++) {
+        char p = m->query[j - 1];
+        if (p == '*')
+            next[j] = prev[j] && next[j - 1];
+        else
+            next[j] = prev[j - 1] || (p != '?' && p != c);
+        if (next[j] < min)
+            min = next[j];
+    }
+    return min;
 }
 
-void __trie_free(trie_node_t *trie_node, void (*free_value_cb)(void*), int alphabet_size) {
-    for (int i = 0; i < alphabet_size; i++) {
-        if (trie_node->children[i]) {
-            __trie_free(trie_node->children[i], free_value_cb, alphabet_size);
+static void __trie_match_visit(trie_match_t *m, trie_node_t *node, int depth) {
+    int width = m->len + 1;
+
+    if (__TRIE_LOAD(&node->end_of_word) && m->rows[depth * width + m->len] <= m->limit) {
+        void *value = __TRIE_LOAD(&node->value);
+        if (m->fuzzy_cb)
+            m->fuzzy_cb(m->key, depth, value, m->rows[depth * width + m->len], m->arg);
+        else
+            m->match_cb(m->key, depth, value, m->arg);
+        m->found++;
+    }
+
+    trie_node_t *child;
+    int slot = -1;
+    while ((child = trie_node_next_child(m->trie, node, slot + 1, &slot)) != NULL) {
+        int end = __trie_key_put_edge(m->trie, &m->key, &m->key_cap, depth, slot, child);
+
+        if ((end + 1) * width > m->rows_cap) {
+            m->rows_cap = 2 * (end + 1) * width;
+            m->rows = realloc(m->rows, m->rows_cap * sizeof(int));
+            DIE(m->rows == NULL, "trie match rows realloc");
         }
+
+        int d = depth, alive = 1;
+        for (; d < end && alive; d++)
+            alive = m->step(m, m->rows + d * width, m->rows + (d + 1) * width, m->key[d]) <= m->limit;
+        if (alive)
+            __trie_match_visit(m, child, end);
     }
-    if (trie_node->end_of_word) {
-        free_value_cb(trie_node->value);
+}
+
+static int __trie_match(trie_match_t *m) {
+    int width = m->len + 1;
+
+    m->rows_cap = 16 * width;
+    m->rows = malloc(m->rows_cap * sizeof(int));
+    DIE(m->rows == NULL, "trie match rows malloc");
+    __trie_key_reserve(&m->key, &m->key_cap, 1);
+
+    /* Row 0: the cost of each query prefix against the empty key */
+    m->rows[0] = 0;
+    for (int j = 1; j <= m->len; j++) {
+        if (m->fuzzy_cb)
+            m->rows[j] = j;
+        else
+            m->rows[j] = m->rows[j - 1] || m->query[j - 1] != '*';
     }
-    free(trie_node->children);
-    free(trie_node);
+
+    __trie_match_visit(m, m->trie->root, 0);
+    free(m->rows);
+    free(m->key);
+    return m->found;
 }
 
+/*
+ * Calls cb for every key within Levenshtein distance max_dist of the len
+ * characters of word, with that distance, in alphabet order. Returns the
+ * number of such keys. The trie must not be modified meanwhile (in concurrent
+ * mode, call it between trie_read_lock and trie_read_unlock).
+ */
+int trie_fuzzy_search(trie_t* trie, const char* word, int len, int max_dist,
+                      void (*cb)(const char* key, int key_len, void* value, int dist, void* arg),
+                      void* arg) {
+    trie_match_t m = {trie, word, len, max_dist, __trie_fuzzy_step,
+                      NULL, 0, NULL, 0, cb, NULL, arg, 0};
+
+    if (max_dist < 0)
+        return 0;
+    return __trie_match(&m);
+}
+
+/*
+ * Calls cb for every key matched by the len characters of pattern, where '?'
+ * stands for any one character and '*' for any (possibly empty) sequence, in
+ * alphabet order. Returns the number of such keys. Same rules as
+ * trie_fuzzy_search for concurrent use.
+ */
+int trie_wildcard_search(trie_t* trie, const char* pattern, int len,
+                         void (*cb)(const char* key, int key_len, void* value, void* arg),
+                         void* arg) {
+    trie_match_t m = {trie, pattern, len, 0, __trie_wildcard_step,
+                      NULL, 0, NULL, 0, NULL, cb, arg, 0};
+
+    return __trie_match(&m);
+}
+
+/*
+ * Every node, edge block and label lives in the pool or the arena, so they are
+ * released a chunk at a time; only the values are freed one by one, walking
+ * the pool in index order.
+ */
 void trie_free(trie_t** pTrie) {
-    __trie_free((*pTrie)->root, (*pTrie)->free_value_cb, (*pTrie)->alphabet_size);
-    free(*pTrie);
+    trie_t *trie = *pTrie;
+
+    for (int chunk = 0; chunk < TRIE_POOL_CHUNKS && trie->pool[chunk]; chunk++) {
+        trie_index_t first = TRIE_POOL_FIRST * ((1u << chunk) - 1);
+        trie_index_t count = (trie_index_t)TRIE_POOL_FIRST << chunk;
+        if (count > trie->pool_used - first)
+            count = trie->pool_used - first;
+
+        for (trie_index_t i = 0; i < count; i++) {
+            trie_node_t *node = &trie->pool[chunk][i];
+            if (first + i != 0 && node->end_of_word)
+                trie->free_value_cb(node->value);
+        }
+        free(trie->pool[chunk]);
+    }
+    __trie_arena_destroy(&trie->arena);
+
+    if (trie->rcu) {
+        for (int i = 0; i < 3; i++)
+            __trie_release_retired(trie, trie->rcu->limbo[i], 1);
+        pthread_mutex_destroy(&trie->rcu->write_lock);
+        free(trie->rcu);
+    }
+
+    free(trie);
     *pTrie = NULL;
-}   
+}
@@ -4,10 +4,16 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <float.h>
+#include <pthread.h>
 
 #define ALPHABET_SIZE 26
 #define ALPHABET "abcdefghijklmnopqrstuvwxyz"
 
+/* alphabet_size of a trie created with alphabet = NULL (any byte value) */
+#define TRIE_BYTE_ALPHABET_SIZE 256
+
 #define DIE(assertion, call_description)                \
     do {                                \
         if (assertion) {                    \
@@ -18,17 +24,141 @@
         }                           \
     } while (0)
 
+/*
+ * Children layouts, chosen by the number of children (ART-style). A node
+ * starts without any edges and moves to a bigger layout when it fills up:
+ *  - TRIE_NODE4 / TRIE_NODE16: up to 4 / 16 children, with their slots kept
+ *    in a sorted array;
+ *  - TRIE_NODE48: up to 48 children, found through an alphabet_size array of
+ *    (position + 1) bytes;
+ *  - TRIE_NODE256: a full array of alphabet_size children.
+ * Layouts that would not be smaller than the full array are skipped.
+ */
+#define TRIE_NODE4 0
+#define TRIE_NODE16 1
+#define TRIE_NODE48 2
+#define TRIE_NODE256 3
+
+/*
+ * Nodes live in a pool owned by their trie and are referred to by 32-bit
+ * indices (0 = no node). Chunk c of the pool holds TRIE_POOL_FIRST << c
+ * nodes and is never moved, so node pointers stay valid while the trie grows.
+ */
+#define TRIE_POOL_FIRST 64
+#define TRIE_POOL_CHUNKS 26
+
+typedef unsigned int trie_index_t;
+
+/*
+ * Edge blocks and labels come from an arena of TRIE_ARENA_CHUNK byte chunks,
+ * in multiples of 8 bytes; released blocks go to a free list per size. Blocks
+ * bigger than TRIE_ARENA_CLASSES * 8 bytes are allocated on their own.
+ */
+#define TRIE_ARENA_CHUNK (1u << 20)
+#define TRIE_ARENA_CLASSES 160
+
+typedef struct trie_arena_large_t trie_arena_large_t;
+struct trie_arena_large_t {
+    trie_arena_large_t* prev;
+    trie_arena_large_t* next;
+};
+
+typedef struct trie_arena_t trie_arena_t;
+struct trie_arena_t {
+    /* Chunks, linked through their first word; the newest one is cut from */
+    void* chunks;
+    char* bump;
+    size_t left;
+    /* Released blocks of (i + 1) * 8 bytes, linked through their first word */
+    void* free[TRIE_ARENA_CLASSES];
+    /* Blocks allocated on their own */
+    trie_arena_large_t* large;
+};
 
+/*
+ * Children of a node, in a single block: the header, the child indices and
+ * then the slot bytes (sorted keys for TRIE_NODE4/16, the index for
+ * TRIE_NODE48, nothing for TRIE_NODE256).
+ */
 typedef struct trie_node_t trie_node_t;
+typedef struct trie_edges_t trie_edges_t;
+struct trie_edges_t {
+    /* One of TRIE_NODE4, TRIE_NODE16, TRIE_NODE48, TRIE_NODE256 */
+    unsigned char type;
+
+    trie_index_t children[];
+};
+
 struct trie_node_t {
     /* Value associated with key (set if end_of_word = 1) */
     void* value;
 
+    /* NULL for leaves */
+    trie_edges_t* edges;
+
     /* 1 if current node marks the end of a word, 0 otherwise */
     int end_of_word;
-
-    trie_node_t** children;
+    /* For a released node: the next one in the pool's free list */
     int n_children;
+
+    /*
+     * Radix mode only: the characters that follow the edge character on the
+     * way to this node (not NUL-terminated). Always empty otherwise.
+     */
+    char* label;
+    int label_len;
+
+    /* Position of the node in the pool */
+    trie_index_t index;
+
+    /* Scored tries only (see trie_set_score): best score in this subtree */
+    double max_score;
+};
+
+/*
+ * trie_build_sorted: inputs of at least TRIE_BUILD_PARALLEL_MIN keys are built
+ * by up to TRIE_BUILD_THREADS threads (one subtrie per first character)
+ */
+#define TRIE_BUILD_THREADS 8
+#define TRIE_BUILD_PARALLEL_MIN (1 << 16)
+
+/* Maximum number of reader threads of a concurrent trie */
+#define TRIE_MAX_READERS 64
+
+/*
+ * Epoch announced by a reader of a concurrent trie: (epoch << 1) | 1 while
+ * inside a read section, 0 otherwise. Each reader has its own cache line.
+ */
+typedef struct trie_reader_t trie_reader_t;
+struct trie_reader_t {
+    unsigned long epoch;
+} __attribute__((aligned(64)));
+
+/* What a trie_retired_t holds */
+#define TRIE_RETIRED_VALUE 0
+#define TRIE_RETIRED_EDGES 1
+#define TRIE_RETIRED_NODE 2
+
+/* Memory unlinked by a writer, waiting until no reader can still see it */
+typedef struct trie_retired_t trie_retired_t;
+struct trie_retired_t {
+    int kind;
+    void* ptr;
+    trie_retired_t* next;
+};
+
+/* State of a concurrent trie (see trie_enable_concurrent) */
+typedef struct trie_rcu_t trie_rcu_t;
+struct trie_rcu_t {
+    trie_reader_t readers[TRIE_MAX_READERS];
+    unsigned int n_readers;
+
+    /* Global epoch; memory retired in epoch e waits in limbo[e % 3] */
+    unsigned long epoch;
+    trie_retired_t* limbo[3];
+
+    /* Serializes writers (insert / remove) and reader registration */
+    pthread_mutex_t write_lock;
 };
 
 typedef struct trie_t trie_t;
@@ -45,17 +175,105 @@ struct trie_t {
     int alphabet_size;
     char* alphabet;
 
+    /* Slot of each byte value (-1 if not in alphabet) and the reverse mapping */
+    short slot_of[TRIE_BYTE_ALPHABET_SIZE];
+    unsigned char char_of[TRIE_BYTE_ALPHABET_SIZE];
+
     /* Callback to free value associated with key, should be called when freeing */
     void (*free_value_cb)(void*);
 
     /* Optional - number of nodes, useful to test correctness */
     int nNodes;
+
+    /* Node pool: indices [1, pool_used) were handed out, released ones are
+     * chained from pool_free */
+    trie_node_t* pool[TRIE_POOL_CHUNKS];
+    trie_index_t pool_used;
+    trie_index_t pool_free;
+
+    /* Memory of the edge blocks and labels */
+    trie_arena_t arena;
+
+    /* NULL unless readers run concurrently with writers */
+    trie_rcu_t* rcu;
+
+    /* 1 if chains of single-child nodes are compressed (see trie_enable_radix) */
+    int radix;
+
+    /* Optional - score of a value, used to rank completions (see trie_top_k) */
+    double (*score_cb)(void*);
+};
+
+/*
+ * Iterator over the keys under a prefix (see trie_prefix_iter), in alphabet
+ * order. It keeps an explicit stack of the nodes on the current path and the
+ * key of the current node; both are released by trie_iter_free.
+ */
+typedef struct trie_iter_frame_t trie_iter_frame_t;
+struct trie_iter_frame_t {
+    trie_node_t* node;
+    /* Last child visited (-1 if none yet, -2 if the node was not reported) */
+    int slot;
+    /* Length of the key of node */
+    int depth;
+};
+
+typedef struct trie_iter_t trie_iter_t;
+struct trie_iter_t {
+    trie_t* trie;
+    trie_iter_frame_t* stack;
+    int top, stack_cap;
+
+    /* Key of the node last returned by trie_iter_next (not NUL-terminated) */
+    char* key;
+    int key_len, key_cap;
 };
 
 trie_t* trie_create(int data_size, int alphabet_size, char* alphabet, void (*free_value_cb)(void*));
-void trie_insert(trie_t* trie, char* key, void* value);
+int trie_insert(trie_t* trie, char* key, void* value);
 void* trie_search(trie_t* trie, char* key);
 int trie_remove(trie_t* trie, char* key);
 void trie_free(trie_t** trie);
+void trie_enable_radix(trie_t* trie);
+
+/* Same as above, for keys of len characters (which may include '\0') */
+int trie_insert_len(trie_t* trie, const char* key, int len, void* value);
+void* trie_search_len(trie_t* trie, const char* key, int len);
+int trie_remove_len(trie_t* trie, const char* key, int len);
+
+int trie_build_sorted(trie_t* trie, char** keys, void* values, int n);
+int trie_build_sorted_len(trie_t* trie, char** keys, int* lens, void* values, int n);
+
+void trie_enable_concurrent(trie_t* trie);
+unsigned int trie_register_reader(trie_t* trie);
+void trie_read_lock(trie_t* trie, unsigned int reader);
+void trie_read_unlock(trie_t* trie, unsigned int reader);
+
+void trie_prefix_iter(trie_t* trie, const char* prefix, int len, trie_iter_t* it);
+trie_node_t* trie_iter_next(trie_iter_t* it);
+void trie_iter_free(trie_iter_t* it);
+
+void trie_set_score(trie_t* trie, double (*score_cb)(void*));
+int trie_top_k(trie_t* trie, const char* prefix, int len, int k,
+               void (*cb)(const char* key, int key_len, void* value, void* arg), void* arg);
+
+int trie_fuzzy_search(trie_t* trie, const char* word, int len, int max_dist,
+                      void (*cb)(const char* key, int key_len, void* value, int dist, void* arg),
+                      void* arg);
+int trie_wildcard_search(trie_t* trie, const char* pattern, int len,
+                         void (*cb)(const char* key, int key_len, void* value, void* arg),
+                         void* arg);
+
+/* Node with the given pool index (not 0) */
+static inline trie_node_t* trie_node_at(trie_t* trie, trie_index_t index) {
+    unsigned int shifted = index + TRIE_POOL_FIRST;
+    int chunk = 31 - __builtin_clz(shifted) - __builtin_ctz(TRIE_POOL_FIRST);
+
+    return &trie->pool[chunk][shifted - ((trie_index_t)TRIE_POOL_FIRST << chunk)];
+}
+
+/* Child access, independent of the node layout (slot = index in alphabet) */
+trie_node_t* trie_node_child(trie_t* trie, trie_node_t* node, int slot);
+trie_node_t* trie_node_next_child(trie_t* trie, trie_node_t* node, int from, int* slot);
 
-#endif
\ No newline at end of file
+#endif